@@ -0,0 +1,309 @@
+//=============================================================================
+//
+// file :        CacheSnapshot.cpp
+//
+// description : Memory mapped snapshot of the polled cache
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <CacheSnapshot.h>
+
+#ifdef _TG_WINDOWS_
+	#include <sys/types.h>
+	#include <sys/timeb.h>
+#else
+	#include <sys/time.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <errno.h>
+#endif
+
+namespace Modbus_ns
+{
+
+#define SNAPSHOT_MAGIC		"MBCACHE"
+#define SNAPSHOT_VERSION	1
+
+//+======================================================================
+// Method:    CacheSnapshot::CacheSnapshot()
+//
+// Description:	Map the snapshot file. Its layout is a header, one
+//				record per block and the block data (8 bytes aligned).
+//				A file written for other blocks is reset.
+//
+// Arg(s) In: - file_name : Snapshot file
+//			  - cdb : Cached blocks, their data buffers allocated
+//-=====================================================================
+
+CacheSnapshot::CacheSnapshot(const string &file_name,vector<CacheDataBlock> &cdb):
+data_blocks(cdb),name(file_name),base(NULL),size(0),matching(false)
+{
+	unsigned long nb_block = data_blocks.size();
+	vector<Record> recs(nb_block);
+	size_t offset = sizeof(Header) + nb_block * sizeof(Record);
+
+	for (unsigned long loop = 0;loop < nb_block;loop++)
+	{
+		CacheDataBlock &b = data_blocks[loop];
+		long nb = b.nb;
+		Record &r = recs[loop];
+		memset(&r,0,sizeof(Record));
+		r.fc = b.fc;
+		r.adr = b.adr;
+		r.nb = nb;
+		if (b.fc == READ_FIFO_QUEUE)
+			r.size = 0;
+		else if (cache_bits(b) == true)
+			r.size = (nb + 7) / 8;
+		else
+			r.size = nb * sizeof(short);
+		r.offset = offset;
+		offset += (r.size + 7) & ~7;
+	}
+
+	map_file(offset);
+
+	Header *h = (Header *)base;
+	matching = (memcmp(h->magic,SNAPSHOT_MAGIC,sizeof(h->magic)) == 0) &&
+			   (h->version == SNAPSHOT_VERSION) && (h->nb_blocks == nb_block);
+	for (unsigned long loop = 0;(loop < nb_block) && (matching == true);loop++)
+	{
+		Record *r = record(loop);
+		matching = (r->fc == recs[loop].fc) && (r->adr == recs[loop].adr) &&
+				   (r->nb == recs[loop].nb) && (r->offset == recs[loop].offset) &&
+				   (r->size == recs[loop].size);
+	}
+
+	if (matching == false)
+	{
+		// Written with another CacheConfig, start from an empty snapshot
+		memset(base,0,size);
+		memcpy(h->magic,SNAPSHOT_MAGIC,sizeof(h->magic));
+		h->version = SNAPSHOT_VERSION;
+		h->nb_blocks = nb_block;
+		for (unsigned long loop = 0;loop < nb_block;loop++)
+			memcpy(record(loop),&recs[loop],sizeof(Record));
+	}
+}
+
+CacheSnapshot::~CacheSnapshot()
+{
+	unmap_file();
+}
+
+//+======================================================================
+// Method:    CacheSnapshot::load()
+//
+// Description:	Copy the saved data into the cache. The blocks are
+//				dated from now and flagged stale, they are served as
+//				usual until the first refresh (the CacheBlock attributes
+//				are INVALID meanwhile). A block never read, saved more
+//				than max_age sec ago or whose write was interrupted (odd
+//				sequence) is skipped.
+//-=====================================================================
+
+long CacheSnapshot::load(long max_age)
+{
+	if (matching == false)
+		return 0;
+
+	long nb_loaded = 0;
+	long long now_us = cache_clock_us();
+	double oldest = (max_age > 0) ? now() - (double)max_age : 0.0;
+	for (unsigned long loop = 0;loop < data_blocks.size();loop++)
+	{
+		Record *r = record(loop);
+		if ((r->size == 0) || (r->date == 0.0) || ((r->seq & 1) != 0))
+			continue;
+		if (r->date < oldest)
+			continue;
+
+		CacheDataBlock &cdb = data_blocks[loop];
+		memcpy(cdb.short_data_cache_ptr,base + r->offset,r->size);
+		cdb.err = false;
+		cdb.date_us = now_us;
+		cdb.stale = true;
+		nb_loaded++;
+	}
+	return nb_loaded;
+}
+
+//+======================================================================
+// Method:    CacheSnapshot::store()
+//
+// Description:	Copy the block into the file. Only its poller writes
+//				the block, it is read without lock. The file is left
+//				to the system, it is flushed when unmapped.
+//-=====================================================================
+
+void CacheSnapshot::store(long block)
+{
+	Record *r = record(block);
+	if (r->size == 0)
+		return;
+
+	r->seq++;
+	CACHE_BARRIER();
+	memcpy(base + r->offset,data_blocks[block].short_data_cache_ptr,r->size);
+	r->date = now();
+	CACHE_BARRIER();
+	r->seq++;
+}
+
+//+======================================================================
+// Method:    CacheSnapshot::map_file()
+//
+// Description:	Open (or create) the file with the given size and map
+//				it. A file of another size is truncated, its content
+//				is then zero and does not match.
+//-=====================================================================
+
+void CacheSnapshot::map_file(size_t file_size)
+{
+	string what;
+
+#ifdef _TG_WINDOWS_
+	file_handle = INVALID_HANDLE_VALUE;
+	map_handle = NULL;
+
+	file_handle = CreateFileA(name.c_str(),GENERIC_READ | GENERIC_WRITE,0,NULL,OPEN_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		what = "open";
+	else
+	{
+		LARGE_INTEGER cur;
+		if (GetFileSizeEx(file_handle,&cur) == 0)
+			what = "stat";
+		else if (cur.QuadPart != (LONGLONG)file_size)
+		{
+			LARGE_INTEGER zero;
+			zero.QuadPart = 0;
+			if ((SetFilePointerEx(file_handle,zero,NULL,FILE_BEGIN) == 0) || (SetEndOfFile(file_handle) == 0))
+				what = "truncate";
+		}
+	}
+
+	if (what.empty() == true)
+	{
+		// The mapping extends the file to its size, with zeros
+		map_handle = CreateFileMappingA(file_handle,NULL,PAGE_READWRITE,0,(DWORD)file_size,NULL);
+		if (map_handle != NULL)
+			base = (char *)MapViewOfFile(map_handle,FILE_MAP_ALL_ACCESS,0,0,file_size);
+		if (base == NULL)
+			what = "map";
+	}
+
+	if (what.empty() == false)
+	{
+		stringstream ss;
+		ss << "Cannot " << what << " the cache snapshot file " << name << " (error " << GetLastError() << ")";
+		if (map_handle != NULL)
+			CloseHandle(map_handle);
+		if (file_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(file_handle);
+		Tango::Except::throw_exception(
+				(const char *)"Modbus_SnapshotError",
+				(const char *)ss.str().c_str(),
+				(const char *)"CacheSnapshot::map_file");
+	}
+#else
+	struct stat st;
+
+	fd = ::open(name.c_str(),O_RDWR | O_CREAT,0644);
+	if (fd == -1)
+		what = "open";
+	else if (fstat(fd,&st) == -1)
+		what = "stat";
+	else if (((size_t)st.st_size != file_size) &&
+			 ((ftruncate(fd,0) == -1) || (ftruncate(fd,file_size) == -1)))
+		what = "resize";
+	else
+	{
+		void *ptr = mmap(NULL,file_size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+		if (ptr == MAP_FAILED)
+			what = "map";
+		else
+			base = (char *)ptr;
+	}
+
+	if (what.empty() == false)
+	{
+		stringstream ss;
+		ss << "Cannot " << what << " the cache snapshot file " << name << " (" << strerror(errno) << ")";
+		if (fd != -1)
+			::close(fd);
+		Tango::Except::throw_exception(
+				(const char *)"Modbus_SnapshotError",
+				(const char *)ss.str().c_str(),
+				(const char *)"CacheSnapshot::map_file");
+	}
+#endif
+
+	size = file_size;
+}
+
+//+======================================================================
+// Method:    CacheSnapshot::unmap_file()
+//-=====================================================================
+
+void CacheSnapshot::unmap_file()
+{
+#ifdef _TG_WINDOWS_
+	FlushViewOfFile(base,size);
+	UnmapViewOfFile(base);
+	CloseHandle(map_handle);
+	CloseHandle(file_handle);
+#else
+	msync(base,size,MS_SYNC);
+	munmap(base,size);
+	::close(fd);
+#endif
+	base = NULL;
+}
+
+//+======================================================================
+// Method:    CacheSnapshot::now()
+//
+// Description:	Wall clock date (sec), the snapshot outlives the process
+//-=====================================================================
+
+double CacheSnapshot::now()
+{
+#ifdef _TG_WINDOWS_
+	struct _timeb now_win;
+	_ftime(&now_win);
+	return (double)now_win.time + (double)now_win.millitm / 1000.0;
+#else
+	struct timeval when;
+	gettimeofday(&when,NULL);
+	return (double)when.tv_sec + (double)when.tv_usec / 1000000.0;
+#endif
+}
+
+} // End of namespace
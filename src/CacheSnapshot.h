@@ -0,0 +1,106 @@
+//+*********************************************************************
+//
+// File:        CacheSnapshot.h
+//
+// Project:     Modbus
+//
+// Description: Memory mapped snapshot of the polled cache
+//
+// This file is part of Tango device class.
+// 
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+
+#ifndef _CacheSnapshot_H
+#define _CacheSnapshot_H
+
+#include <tango.h>
+#include <CacheThread.h>
+
+namespace Modbus_ns
+{
+
+//+=====================================================================
+// Snapshot of the polled cache (CacheConfig) in a memory mapped file.
+// Each refresh copies the block data into the file, which therefore
+// holds the last values read when the server stops or crashes. At
+// init, the blocks of a file written with the same CacheConfig are
+// reloaded and served (flagged stale) until their first refresh.
+// FIFO blocks are not saved.
+//-=====================================================================
+
+class CacheSnapshot
+{
+public:
+	// Map the file, created or reset when it does not match the blocks
+	CacheSnapshot(const string &file_name,vector<CacheDataBlock> &cdb);
+	~CacheSnapshot();
+
+	// Copy the saved values into the cache, before the polling starts.
+	// Values older than max_age (sec, 0: no limit) are not loaded.
+	// Return the number of blocks loaded.
+	long load(long max_age);
+
+	// Save a block just read, called by its poller
+	void store(long block);
+
+protected:
+	struct Header
+	{
+		char				magic[8];
+		unsigned int		version;
+		unsigned int		nb_blocks;
+	};
+
+	struct Record
+	{
+		int					fc;
+		int					adr;
+		int					nb;
+		unsigned int		offset;		// Data offset in the file
+		unsigned int		size;		// Data size (bytes)
+		unsigned int		seq;		// Odd while the data is written
+		double				date;		// Wall clock date of the data (sec), 0 if never read
+	};
+
+	vector<CacheDataBlock>		&data_blocks;
+	string						name;
+	char						*base;
+	size_t						size;
+	bool						matching;
+#ifdef _TG_WINDOWS_
+	HANDLE						file_handle;
+	HANDLE						map_handle;
+#else
+	int							fd;
+#endif
+
+	Record *record(long block) {return (Record *)(base + sizeof(Header)) + block;}
+	void map_file(size_t);
+	void unmap_file();
+	static double now();
+};
+
+} // End of namespace
+
+#endif /* _CacheSnapshot_H */
@@ -6,7 +6,7 @@ static char RcsId[] = "@(#) $Header: /users/chaize/newsvn/cvsroot/Communication/
 //
 // Project:	Device Servers in C++
 //
-// Description:	Code for implementing the Modbus data cache thread
+// Description:	Code for implementing the Modbus data cache polling
 //
 // Author(s);	Emmanuel Taurel
 //
@@ -49,6 +49,9 @@ static char RcsId[] = "@(#) $Header: /users/chaize/newsvn/cvsroot/Communication/
 #include <tango.h>
 #include <CacheThread.h>
 #include <Modbus.h>
+#include <algorithm>
+#include <math.h>
+#include <errno.h>
 
 #ifdef _TG_WINDOWS_
 	#include <sys/types.h>
@@ -58,149 +61,782 @@ static char RcsId[] = "@(#) $Header: /users/chaize/newsvn/cvsroot/Communication/
 namespace Modbus_ns
 {
 
+// Longest wait of an idle polling worker (sec)
+#define CACHE_THREAD_MAX_SLEEP	0.2
+// Adaptive polling: unchanged reads before doubling the period
+#define CACHE_ADAPT_UNCHANGED	4
+
 //+======================================================================
-// Method:    CacheThread::run_undetached()
+// Method:    CachePoller::CachePoller()
 //
-// Description:	create the instance of the thread used to fill up the
-//				cahce
+// Description:	create the cache schedule of one device connection.
+//				The first refresh of a block is delayed by its phase.
 //
 // Arg(s) In: - cdb : list of data to be cached
-//			  - c_mut : mutex used to protect the thread command area
-//			  - cmd : Pointer to the command area
-//			  - s_time : Thread loop sleeping time
-//			  - d_name : Modbus device name
+//			  - blocks : Index of the blocks polled by this poller
+//			  - s_time : Refresh period of the blocks without period (ms)
+//			  - max_p : Longest period with adaptive polling, 0 if not used (ms)
+//			  - c : Dedicated connection, NULL to use the device one
+//			  - d : Modbus device
 //
 //-=====================================================================
 
-CacheThread::CacheThread(vector<CacheDataBlock> &cdb,omni_mutex &c_mut,ThreadCmd *cmd,long s_time,Modbus *d):
-data_blocks(cdb),cmd_mutex(c_mut),th_cmd(cmd),the_dev(d)
+CachePoller::CachePoller(vector<CacheDataBlock> &cdb,const vector<unsigned long> &blocks,long s_time,long max_p,ModbusCore *c,Modbus *d):
+data_blocks(cdb),core(c),the_dev(d),owner(0),running(false),removed(false)
 {
-	sleeping_time_s = s_time / 1000;
-	sleeping_time_ns = (s_time % 1000) * 1000000;
-}
+	default_period = s_time / 1000.0;
+	max_period = max_p / 1000.0;
 
+	unsigned long nb_block = data_blocks.size();
+	double start = now();
+	for (unsigned long loop = 0;loop < blocks.size();loop++)
+		schedule.push(Refresh(start + data_blocks[blocks[loop]].phase / 1000.0,blocks[loop]));
+
+	adapt_period.resize(nb_block,0.0);
+	nb_unchanged.resize(nb_block,0);
+}
 
 //+======================================================================
-// Method:    CacheThread::run_undetached()
+// Method:    CachePoller::next_date()
 //
-// Description:	create a ModbusCore object
+// Description:	Called by the pool (mutex taken). The blocks to
+//				refresh after a write are due now.
+//-=====================================================================
+
+double CachePoller::next_date()
+{
+	if (urgent.empty() == false)
+		return 0.0;
+	return schedule.top().first;
+}
+
+//+======================================================================
+// Method:    CachePoller::poll()
 //
-// Arg(s) In:	
+// Description:	Refresh the first block of the schedule. A block
+//				with a period in CacheConfig is refreshed on the grid
+//				phase + n * period, the other ones every CacheSleep ms.
+//				The deadlines are absolute monotonic dates, the period does
+//				not drift with the read duration. When a refresh is late,
+//				the missed deadlines are skipped and counted as overruns.
+//				With adaptive polling, the period of a block is doubled
+//				each time its data did not change for a few reads, up to
+//				the max period, and set back to the configured one as
+//				soon as a change is read.
 //
-// Arg(s) Out:	
+// Return:		Date of the next refresh
 //-=====================================================================
 
-void *CacheThread::run_undetached(void *ptr)
+double CachePoller::poll()
 {
-	bool exit = false;
-	unsigned long nb_block = data_blocks.size();
-	struct timeval when;
+	Refresh next = schedule.top();
+	schedule.pop();
+
+	double t = now();
+	CacheDataBlock &cdb = data_blocks[next.second];
+	double late = t - next.first;
+	if (late < 0.0)
+		late = 0.0;
+
+	bool changed = read_block(next.second);
 
 //
-// Thread loop
+// Adaptive polling
 //
 
-	try
+	double period = (cdb.period != 0) ? cdb.period / 1000.0 : default_period;
+	if ((max_period > period) && (cdb.fc != READ_FIFO_QUEUE))
 	{
-		while (exit == false)
+		double &ap = adapt_period[next.second];
+		if ((changed == true) || (ap == 0.0))
 		{
-			//cout << "In cache Thread loop" << endl;
+			ap = period;
+			nb_unchanged[next.second] = 0;
+		}
+		else if (++nb_unchanged[next.second] >= CACHE_ADAPT_UNCHANGED)
+		{
+			ap = (ap * 2.0 > max_period) ? max_period : ap * 2.0;
+			nb_unchanged[next.second] = 0;
+		}
+		period = ap;
+	}
 
 //
-// Read thread command
+// Next deadline on the period grid. When the read ends after the
+// next deadline, the missed deadlines are skipped and counted as
+// overruns.
 //
 
-			
-			ThreadCmd the_cmd;
-			{
-				omni_mutex_lock sync(cmd_mutex);
-				the_cmd = *th_cmd;
-			}
+	double date = next.first + period;
+	unsigned long missed = 0;
+	double end = now();
+	if (date <= end)
+	{
+		if (period > 0.0)
+		{
+			missed = (unsigned long)floor((end - date) / period) + 1;
+			date += missed * period;
+		}
+		else
+			date = end;
+	}
+	schedule.push(Refresh(date,next.second));
 
-			if (the_cmd == SUICIDE)
-			{
-				exit = true;
-				continue;
-			}
+	{
+		omni_mutex_lock sync(*(cdb.data_block_mutex));
+		CacheTiming &tm = cdb.timing;
+		if (tm.nb_refresh != 0)
+		{
+			double measured = t - tm.last_start;
+			tm.sum_period += measured;
+			tm.sum_period2 += measured * measured;
+		}
+		tm.last_start = t;
+		tm.cur_period = period;
+		tm.nb_refresh++;
+		tm.overruns += missed;
+		if (late > tm.max_late)
+			tm.max_late = late;
+	}
 
-			for (unsigned long loop = 0;loop < nb_block;loop++)
-			{
-//				cout << "Cmd = " << data_blocks[loop].cmd_name << endl;
-//				cout << "Adr = " << data_blocks[loop].in_args[0] << endl;
-//				cout << "nb_data = " << data_blocks[loop].in_args[1] << endl;
+	return schedule.top().first;
+}
+
+//+======================================================================
+// Method:    CachePoller::refresh()
+//
+// Description:	Read blocks out of their schedule, after a write to
+//				their range. The schedule is not changed. With adaptive
+//				polling, the period of a block which changed is reset.
+//-=====================================================================
 
+void CachePoller::refresh(const vector<unsigned long> &blocks)
+{
+	for (unsigned long loop = 0;loop < blocks.size();loop++)
+	{
+		if (read_block(blocks[loop]) == true)
+		{
+			adapt_period[blocks[loop]] = 0.0;
+			nb_unchanged[blocks[loop]] = 0;
+		}
+	}
+}
+
+//+======================================================================
+// Method:    CachePoller::read_block()
+//
+// Description:	Read one block, copy the data in the cache and push
+//				its change events. The block is dated with the monotonic
+//				clock at the end of the read, the read duration is kept
+//				as the acquisition latency.
+//
+// Arg(s) In:	- loop : Block index
+//
+// Return:		true when the data (or the error state) changed
+//-=====================================================================
+
+bool CachePoller::read_block(unsigned long loop)
+{
+//	cout << "Cmd = " << cache_cmd_name(data_blocks[loop].fc) << endl;
+//	cout << "Adr = " << data_blocks[loop].adr << endl;
+//	cout << "nb_data = " << data_blocks[loop].nb << endl;
+
+	// Wall clock date of the FIFO and history samples
+	struct timeval when;
 #ifdef _TG_WINDOWS_
-				struct _timeb now_win;
-				_ftime(&now_win);
-				when.tv_sec = (unsigned long)now_win.time;
-				when.tv_usec = (long)now_win.millitm * 1000;
+	struct _timeb now_win;
+	_ftime(&now_win);
+	when.tv_sec = (unsigned long)now_win.time;
+	when.tv_usec = (long)now_win.millitm * 1000;
 #else
-				gettimeofday(&when,NULL);
+	gettimeofday(&when,NULL);
 #endif
-				
+	long long start_us = cache_clock_us();
+	long long date_us;
+
+	// The cache thread is the only writer of the data, it reads its own
+	// cache without sequence lock
+	bool changed = (data_blocks[loop].date_us == 0) || (data_blocks[loop].err == true);
+	
 //
 // Read the data and copy them
 // Do not use command_inout on a DeviceProxy, because this will take
 // the device monitor and therefore blocks other commands during the
 // reading.
 
-				try
-				{
-					if (data_blocks[loop].cmd_name == "readholdingregisters")
-					{
-						Tango::DevVarShortArray *dvsa = the_dev->read_holding_registers(&data_blocks[loop].in_args);
-						{
-							omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
-							::memcpy((void *)data_blocks[loop].short_data_cache_ptr,(void *)dvsa->get_buffer(),(size_t)dvsa->length() * 2);
-							data_blocks[loop].err = false;
-							data_blocks[loop].nb_sec = when.tv_sec;
-						}
-						delete dvsa;
-					}
-					else if (data_blocks[loop].cmd_name == "readmultiplecoilsstatus")
-					{
-						Tango::DevVarShortArray *dvsa = the_dev->read_multiple_coils_status(&data_blocks[loop].in_args);
-						{
-							omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
-							::memcpy((void *)data_blocks[loop].short_data_cache_ptr,(void *)dvsa->get_buffer(),(size_t)dvsa->length() * 2);
-							data_blocks[loop].err = false;
-							data_blocks[loop].nb_sec = when.tv_sec;
-						}
-						delete dvsa;
-					}
-					else
-					{
-						Tango::DevVarShortArray *dvsa = the_dev->read_input_registers(&data_blocks[loop].in_args);
-						{
-							omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
-							::memcpy((void *)data_blocks[loop].short_data_cache_ptr,(void *)dvsa->get_buffer(),(size_t)dvsa->length() * 2);
-							data_blocks[loop].err = false;
-							data_blocks[loop].nb_sec = when.tv_sec;
-						}
-						delete dvsa;
-					}
-				}
-				catch (Tango::DevFailed &e)
-				{
-					//Tango::Except::print_exception(e);
-					{
-						omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
-						data_blocks[loop].err = true;
-						data_blocks[loop].errors = e.errors;
-						data_blocks[loop].nb_sec = when.tv_sec;
-					}
-				}
+	try
+	{
+		if (data_blocks[loop].fc == READ_FIFO_QUEUE)
+		{
+			the_dev->drain_fifo(loop,when.tv_sec + when.tv_usec / 1000000.0);
+			date_us = cache_clock_us();
+			omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
+			cache_write_begin(data_blocks[loop]);
+			data_blocks[loop].err = false;
+			data_blocks[loop].stale = false;
+			data_blocks[loop].date_us = date_us;
+			data_blocks[loop].latency_us = (long)(date_us - start_us);
+			cache_write_end(data_blocks[loop]);
+		}
+		else if (cache_bits(data_blocks[loop]) == true)
+		{
+			long nb = data_blocks[loop].nb;
+			vector<unsigned char> bits((nb + 7) / 8);
+			the_dev->read_bits(data_blocks[loop].fc,data_blocks[loop].adr,nb,&bits[0]);
+			date_us = cache_clock_us();
+			changed = changed || (::memcmp(data_blocks[loop].short_data_cache_ptr,&bits[0],bits.size()) != 0);
+			{
+				omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
+				cache_write_begin(data_blocks[loop]);
+				::memcpy((void *)data_blocks[loop].short_data_cache_ptr,(void *)&bits[0],bits.size());
+				data_blocks[loop].err = false;
+				data_blocks[loop].stale = false;
+				data_blocks[loop].date_us = date_us;
+				data_blocks[loop].latency_us = (long)(date_us - start_us);
+				cache_write_end(data_blocks[loop]);
 			}
-		
-			omni_thread::sleep(sleeping_time_s,sleeping_time_ns);
-		}	
+			the_dev->snapshot_cache_block(loop);
+			the_dev->record_history(loop,when.tv_sec + when.tv_usec / 1000000.0);
+		}
+		else
+		{
+			Tango::DevVarShortArray *dvsa = the_dev->read_cache_block(loop);
+			date_us = cache_clock_us();
+			changed = changed || (::memcmp(data_blocks[loop].short_data_cache_ptr,dvsa->get_buffer(),(size_t)dvsa->length() * 2) != 0);
+			{
+				omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
+				cache_write_begin(data_blocks[loop]);
+				::memcpy((void *)data_blocks[loop].short_data_cache_ptr,(void *)dvsa->get_buffer(),(size_t)dvsa->length() * 2);
+				data_blocks[loop].err = false;
+				data_blocks[loop].stale = false;
+				data_blocks[loop].date_us = date_us;
+				data_blocks[loop].latency_us = (long)(date_us - start_us);
+				cache_write_end(data_blocks[loop]);
+			}
+			delete dvsa;
+			the_dev->snapshot_cache_block(loop);
+			the_dev->record_history(loop,when.tv_sec + when.tv_usec / 1000000.0);
+		}
+	}
+	catch (Tango::DevFailed &e)
+	{
+		//Tango::Except::print_exception(e);
+		date_us = cache_clock_us();
+		changed = (data_blocks[loop].err == false);
+		{
+			omni_mutex_lock sync(*(data_blocks[loop].data_block_mutex));
+			data_blocks[loop].errors = e.errors;
+			cache_write_begin(data_blocks[loop]);
+			data_blocks[loop].err = true;
+			data_blocks[loop].stale = false;
+			data_blocks[loop].date_us = date_us;
+			data_blocks[loop].latency_us = (long)(date_us - start_us);
+			cache_write_end(data_blocks[loop]);
+		}
+	}
+
+//
+// Push change events for the block (if configured)
+//
+
+	the_dev->push_cache_event(loop);
+
+	return changed;
+}
+
+//+======================================================================
+// Method:    cache_clock_us()
+//
+// Description:	Monotonic date (us) of the cached data. Never 0, which
+//				marks a block not read yet.
+//-=====================================================================
+
+long long cache_clock_us()
+{
+#ifdef _TG_WINDOWS_
+	LARGE_INTEGER freq,count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (long long)(count.QuadPart / freq.QuadPart) * 1000000 +
+		   (long long)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart + 1;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + 1;
+#endif
+}
+
+//+======================================================================
+// Method:    CachePoller::now()
+//
+// Description:	Monotonic date (sec) used for the refresh deadlines
+//-=====================================================================
+
+double CachePoller::now()
+{
+	return (double)cache_clock_us() / 1000000.0;
+}
+
+//+======================================================================
+// Method:    MonotonicCondition::MonotonicCondition()
+//
+// Description:	The POSIX condition is bound to CLOCK_MONOTONIC, the
+//				Windows one takes a relative timeout
+//-=====================================================================
+
+MonotonicCondition::MonotonicCondition()
+{
+#ifdef _TG_WINDOWS_
+	InitializeCriticalSection(&mutex);
+	InitializeConditionVariable(&cond);
+#else
+	pthread_condattr_t attr;
+	pthread_mutex_init(&mutex,NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr,CLOCK_MONOTONIC);
+	pthread_cond_init(&cond,&attr);
+	pthread_condattr_destroy(&attr);
+#endif
+}
+
+MonotonicCondition::~MonotonicCondition()
+{
+#ifdef _TG_WINDOWS_
+	DeleteCriticalSection(&mutex);
+#else
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+#endif
+}
+
+void MonotonicCondition::lock()
+{
+#ifdef _TG_WINDOWS_
+	EnterCriticalSection(&mutex);
+#else
+	pthread_mutex_lock(&mutex);
+#endif
+}
+
+void MonotonicCondition::unlock()
+{
+#ifdef _TG_WINDOWS_
+	LeaveCriticalSection(&mutex);
+#else
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void MonotonicCondition::wait()
+{
+#ifdef _TG_WINDOWS_
+	SleepConditionVariableCS(&cond,&mutex,INFINITE);
+#else
+	pthread_cond_wait(&cond,&mutex);
+#endif
+}
+
+void MonotonicCondition::broadcast()
+{
+#ifdef _TG_WINDOWS_
+	WakeAllConditionVariable(&cond);
+#else
+	pthread_cond_broadcast(&cond);
+#endif
+}
+
+//+======================================================================
+// Method:    MonotonicCondition::wait_until()
+//
+// Description:	Wait for a broadcast or until an absolute monotonic
+//				date (sec), the date of CachePoller::now()
+//-=====================================================================
+
+void MonotonicCondition::wait_until(double date)
+{
+	double delay = date - CachePoller::now();
+	if (delay <= 0.0)
+		return;
+#ifdef _TG_WINDOWS_
+	SleepConditionVariableCS(&cond,&mutex,(DWORD)(delay * 1000.0 + 0.5));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)date;
+	ts.tv_nsec = (long)((date - (double)ts.tv_sec) * 1000000000.0);
+	pthread_cond_timedwait(&cond,&mutex,&ts);
+#endif
+}
+
+//+======================================================================
+// Polling pool
+//-=====================================================================
+
+PollingPool *PollingPool::_instance = NULL;
+omni_mutex PollingPool::instance_mutex;
+long PollingPool::nb_users = 0;
+int PollingPool::worker_ids[POLLING_MAX_THREADS];
+volatile long PollingPool::nb_worker_ids = 0;
+
+PollingPool::PollingPool():nb_workers(0),stopping(false),next_owner(0)
+{
+	for (long i = 0;i < POLLING_MAX_THREADS;i++)
+		workers[i] = NULL;
+}
+
+//+======================================================================
+// Method:    PollingPool::acquire()
+//
+// Description:	Return the pool, created by the first device
+//-=====================================================================
+
+PollingPool *PollingPool::acquire(long nb_threads)
+{
+	omni_mutex_lock sync(instance_mutex);
+	if (_instance == NULL)
+		_instance = new PollingPool();
+	nb_users++;
+	_instance->resize(nb_threads);
+	return _instance;
+}
+
+//+======================================================================
+// Method:    PollingPool::release()
+//
+// Description:	Called by a device once its pollers are removed. The
+//				last device stops and joins the workers (the thread
+//				objects are deleted by join) and frees the pool.
+//-=====================================================================
+
+void PollingPool::release()
+{
+	omni_mutex_lock sync(instance_mutex);
+	if ((_instance == NULL) || (--nb_users > 0))
+		return;
+
+	PollingPool *pool = _instance;
+	pool->stopping = true;
+	for (long i = 0;i < pool->nb_workers;i++)
+	{
+		MonotonicCondition::Sync wsync(pool->workers[i]->cond);
+		pool->workers[i]->cond.broadcast();
 	}
-	catch (omni_thread_fatal &otf)
+	for (long i = 0;i < pool->nb_workers;i++)
 	{
-		cout << "omni_thread_fatal......." << endl;
+		void *ptr = 0;
+		pool->workers[i]->join(&ptr);
 	}
 
+	nb_worker_ids = 0;
+	CACHE_BARRIER();
+	_instance = NULL;
+	delete pool;
+}
+
+//+======================================================================
+// Method:    PollingPool::resize()
+//
+// Description:	Start new workers up to nb_threads (instance mutex
+//				taken). The worker ids and the workers are published
+//				before the workers start, is_worker() and the thieves
+//				read them without lock.
+//-=====================================================================
+
+void PollingPool::resize(long nb_threads)
+{
+	if (nb_threads > POLLING_MAX_THREADS)
+		nb_threads = POLLING_MAX_THREADS;
+
+	while (nb_workers < nb_threads)
+	{
+		Worker *w = new Worker(this,nb_workers);
+		worker_ids[nb_workers] = w->id();
+		workers[nb_workers] = w;
+		CACHE_BARRIER();
+		nb_worker_ids = nb_workers + 1;
+		nb_workers = nb_workers + 1;
+		w->start();
+	}
+}
+
+//+======================================================================
+// Method:    PollingPool::add()
+//
+// Description:	Give the device to a worker, round robin
+//-=====================================================================
+
+void PollingPool::add(CachePoller *p)
+{
+	long owner;
+	{
+		omni_mutex_lock sync(instance_mutex);
+		owner = next_owner;
+		next_owner = (next_owner + 1) % nb_workers;
+	}
+
+	Worker *w = workers[owner];
+	MonotonicCondition::Sync sync(w->cond);
+	p->owner = owner;
+	p->running = false;
+	p->removed = false;
+	p->stamp = 0;
+	schedule(w,p);
+	w->cond.broadcast();
+}
+
+//+======================================================================
+// Method:    PollingPool::remove()
+//
+// Description:	The owner of a running device does not change, wait
+//				on its worker. The heap entry left is made invalid.
+//-=====================================================================
+
+void PollingPool::remove(CachePoller *p)
+{
+	Worker *w = lock_owner(p);
+	p->removed = true;
+	while (p->running == true)
+		w->cond.wait();
+	p->stamp = p->stamp + 1;
+	w->cond.unlock();
+}
+
+//+======================================================================
+// Method:    PollingPool::refresh()
+//
+// Description:	Queue the block on its poller, which becomes due now
+//-=====================================================================
+
+void PollingPool::refresh(CachePoller *p,unsigned long block)
+{
+	Worker *w = lock_owner(p);
+	if (find(p->urgent.begin(),p->urgent.end(),block) == p->urgent.end())
+		p->urgent.push_back(block);
+	if ((p->running == false) && (p->removed == false))
+		schedule(w,p);
+	w->cond.broadcast();
+	w->cond.unlock();
+}
+
+//+======================================================================
+// Method:    PollingPool::lock_owner()
+//
+// Description:	Lock the worker owning a device. The owner only
+//				changes under the lock of the previous one, it is
+//				checked again once locked.
+//-=====================================================================
+
+PollingPool::Worker *PollingPool::lock_owner(CachePoller *p)
+{
+	while (true)
+	{
+		Worker *w = workers[p->owner];
+		w->cond.lock();
+		if (p->owner == w->index)
+			return w;
+		w->cond.unlock();
+	}
+}
+
+//+======================================================================
+// Method:    PollingPool::schedule()
+//
+// Description:	Push the device in the heap of its worker (lock
+//				taken) at its next refresh date. The previous entry
+//				of the device, if any, becomes invalid.
+//-=====================================================================
+
+void PollingPool::schedule(Worker *w,CachePoller *p)
+{
+	p->stamp = p->stamp + 1;
+	if ((p->schedule.empty() == true) && (p->urgent.empty() == true))
+		return;
+
+	Entry e;
+	e.date = p->next_date();
+	e.poller = p;
+	e.stamp = p->stamp;
+	w->heap.push(e);
+}
+
+//+======================================================================
+// Method:    PollingPool::pop_due()
+//
+// Description:	Take the first device of a worker heap (lock taken)
+//				if it is due. The invalid entries met are dropped.
+//
+// Arg(s) In:	- w : Worker
+//				- t : Current date
+//
+// Arg(s) Out:	- next : Lowered to the first date of the heap
+//-=====================================================================
+
+CachePoller *PollingPool::pop_due(Worker *w,double t,double &next)
+{
+	while (w->heap.empty() == false)
+	{
+		const Entry &e = w->heap.top();
+		if (e.stamp != e.poller->stamp)
+		{
+			w->heap.pop();
+			continue;
+		}
+		if (e.date > t)
+		{
+			if (e.date < next)
+				next = e.date;
+			return NULL;
+		}
+		CachePoller *p = e.poller;
+		w->heap.pop();
+		return p;
+	}
+	return NULL;
+}
+
+//+======================================================================
+// Method:    PollingPool::steal()
+//
+// Description:	Take a due device from another worker, the first one
+//				found. The device is flagged running before its owner
+//				changes, a remove() waiting on the thief sees it.
+//-=====================================================================
+
+CachePoller *PollingPool::steal(long index,double t)
+{
+	long nb = nb_workers;
+	for (long k = 1;k < nb;k++)
+	{
+		Worker *v = workers[(index + k) % nb];
+		double next = t;
+		MonotonicCondition::Sync sync(v->cond);
+		CachePoller *p = pop_due(v,t,next);
+		if (p != NULL)
+		{
+			p->running = true;
+			CACHE_BARRIER();
+			p->owner = index;
+			return p;
+		}
+	}
 	return NULL;
 }
 
+//+======================================================================
+// Method:    PollingPool::is_worker()
+//-=====================================================================
+
+bool PollingPool::is_worker(int thread_id)
+{
+	return worker_index(thread_id) != -1;
+}
+
+long PollingPool::worker_index(int thread_id)
+{
+	long nb = nb_worker_ids;
+	CACHE_BARRIER();
+	for (long i = 0;i < nb;i++)
+	{
+		if (worker_ids[i] == thread_id)
+			return i;
+	}
+	return -1;
+}
+
+//+======================================================================
+// Method:    PollingPool::current_poller()
+//
+// Description:	Only the worker itself changes its running entry, it
+//				can read it without lock
+//-=====================================================================
+
+CachePoller *PollingPool::current_poller()
+{
+	omni_thread *th = omni_thread::self();
+	if ((th == NULL) || (_instance == NULL))
+		return NULL;
+
+	long index = worker_index(th->id());
+	if (index == -1)
+		return NULL;
+	return _instance->workers[index]->running;
+}
+
+//+======================================================================
+// Method:    PollingPool::work()
+//
+// Description:	Worker loop. Poll the due devices of the worker,
+//				otherwise steal a due device, otherwise wait for the
+//				first refresh date or for a device to be added. The
+//				wait is bounded to look for due devices of the other
+//				workers again. The wait runs on the monotonic clock,
+//				like the refresh dates. The worker survives any error
+//				of a poll: the device is always released and the error
+//				goes to the device log.
+//-=====================================================================
+
+void PollingPool::work(long index)
+{
+	Worker *w = workers[index];
+	w->cond.lock();
+
+	while (stopping == false)
+	{
+		double t = CachePoller::now();
+		double next = t + CACHE_THREAD_MAX_SLEEP;
+		CachePoller *p = pop_due(w,t,next);
+
+		if (p != NULL)
+			p->running = true;
+		else
+		{
+			w->cond.unlock();
+			p = steal(index,t);
+			w->cond.lock();
+			if (p == NULL)
+			{
+				// A device may have been added while stealing
+				if ((w->heap.empty() == false) && (w->heap.top().date < next))
+					next = w->heap.top().date;
+				if (stopping == false)
+					w->cond.wait_until(next);
+				continue;
+			}
+		}
+
+		vector<unsigned long> urgent;
+		urgent.swap(p->urgent);
+		w->running = p;
+		w->cond.unlock();
+		try
+		{
+			if (urgent.empty() == false)
+				p->refresh(urgent);
+			else
+				p->poll();
+		}
+		catch (Tango::DevFailed &e)
+		{
+			p->the_dev->cache_poll_failed(e.errors[0].desc.in());
+		}
+		catch (omni_thread_fatal &)
+		{
+			p->the_dev->cache_poll_failed("omni_thread_fatal");
+		}
+		catch (...)
+		{
+			p->the_dev->cache_poll_failed("unknown exception");
+		}
+		w->cond.lock();
+		w->running = NULL;
+		p->running = false;
+		if (p->removed == false)
+			schedule(w,p);
+
+		// Wake up a remove() waiting for this device
+		w->cond.broadcast();
+	}
+
+	w->cond.unlock();
+}
+
 } // End of namespace
@@ -5,7 +5,7 @@
 // Project:     Device Servers in C++
 //
 // Description: public include file containing definitions and declarations
-//		for implementing the thread dedicated to filling the data cache
+//		for implementing the threads dedicated to filling the data cache
 //
 // Author(s);   Emmanuel Taurel
 //
@@ -49,6 +49,8 @@
 #ifndef _CacheThread_H
 #define _CacheThread_H
 
+#include <ModbusCore.h>
+#include <queue>
 
 
 //+=====================================================================
@@ -60,39 +62,323 @@ namespace Modbus_ns
 
 class Modbus;
 
-typedef enum
+struct CacheTiming
 {
-	RUN = 0,
-	SUICIDE
-}ThreadCmd;
+	unsigned long		nb_refresh;
+	unsigned long		overruns;		// Deadlines missed
+	double				last_start;		// Monotonic date (sec)
+	double				sum_period;		// Measured periods (sec)
+	double				sum_period2;
+	double				max_late;		// Max start delay after the deadline (sec)
+	double				cur_period;		// Current period, adaptive polling (sec)
+};
+
+//
+// Cached block. The fields read on each cache access come first. The
+// buffers are in the device arenas and the mutex in the device mutex
+// array (see init_device). The error list is only filled on error.
+//
 
 struct CacheDataBlock
 {
-	string				cmd_name;
-	Tango::DevVarShortArray		in_args;
+	volatile unsigned long		seq;
+	unsigned char			fc;
 	bool				err;
-	Tango::DevErrorList		errors;
-	omni_mutex			*data_block_mutex;
+	bool				stale;			// Loaded from the snapshot, not read yet
+	unsigned short			adr;			// First address
+	long				nb;				// Number of data (FIFO: ring size)
 	short				*short_data_cache_ptr;
-	unsigned int			nb_sec;
+	long long			date_us;		// Monotonic date of the last read (us), 0 before
+	long				latency_us;		// Duration of the last read (us)
+	long long			write_us;		// Monotonic date of the last write to the range (us)
+	long long			max_age_us;		// Older data means the thread is dead
+	omni_mutex			*data_block_mutex;
+	short				*event_data_ptr;
+	bool				event_valid;
+	bool				event_err;
+	double				*fifo_time_ptr;
+	unsigned long			fifo_write;
+	short				*history_ptr;		// History ring, in the device arena
+	double				*history_time_ptr;
+	unsigned long			history_write;
+	long				period;
+	long				phase;
+	CacheTiming			timing;
+	Tango::DevErrorList		errors;
 };
 
-class CacheThread: public omni_thread
+//
+// Coils (FC1) and discrete inputs (FC2) are cached as packed bits,
+// in the frame layout (first bit in the LSB of the first byte)
+//
+
+inline bool cache_bits(const CacheDataBlock &cdb)
+{
+	return (cdb.fc == READ_COIL_STATUS) || (cdb.fc == READ_INPUT_STATUS);
+}
+
+// Cache line size assumed for the arena layout
+#define CACHE_LINE_SIZE		64
+
+// Number of elements rounded up to whole cache lines
+inline size_t cache_line_round(size_t nb,size_t elt_size)
+{
+	size_t per_line = CACHE_LINE_SIZE / elt_size;
+	return (nb + per_line - 1) / per_line * per_line;
+}
+
+// First cache line boundary in a buffer
+inline void *cache_line_align(void *ptr)
+{
+	return (void *)(((size_t)ptr + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1));
+}
+
+// Command name of a cached function code
+inline const char *cache_cmd_name(unsigned char fc)
+{
+	switch (fc)
+	{
+		case READ_HOLDING_REGISTERS:	return "ReadHoldingRegisters";
+		case READ_INPUT_REGISTERS:		return "ReadInputRegisters";
+		case READ_COIL_STATUS:			return "ReadMultipleCoilsStatus";
+		case READ_INPUT_STATUS:			return "ReadInputStatus";
+		default:						return "ReadFifoQueue";
+	}
+}
+
+// Size of the block data buffer (in shorts)
+inline long cache_words(const CacheDataBlock &cdb)
+{
+	long nb = cdb.nb;
+	return (cache_bits(cdb) == true) ? (nb + 15) / 16 : nb;
+}
+
+//
+// Cache index entry. Per function code, the blocks sorted on their
+// first address. max_end/max_block give the block reaching the
+// highest address among this entry and the previous ones.
+//
+
+struct CacheIndexEntry
+{
+	long				start;
+	long				max_end;
+	int					max_block;
+};
+
+//
+// Sequence lock on the block data, error flag and dates. The writers
+// (the cache thread, and write_invalidate for the write date) hold the
+// data block mutex, readers copy without lock, retrying when the
+// sequence changed during their copy. The error list and the FIFO ring
+// are also protected by the data block mutex.
+//
+
+#ifdef _TG_WINDOWS_
+	#define CACHE_BARRIER()	MemoryBarrier()
+#else
+	#define CACHE_BARRIER()	__sync_synchronize()
+#endif
+
+inline void cache_write_begin(CacheDataBlock &cdb)
+{
+	cdb.seq = cdb.seq + 1;
+	CACHE_BARRIER();
+}
+
+inline void cache_write_end(CacheDataBlock &cdb)
+{
+	CACHE_BARRIER();
+	cdb.seq = cdb.seq + 1;
+}
+
+inline unsigned long cache_read_begin(const CacheDataBlock &cdb)
+{
+	unsigned long s;
+	while (((s = cdb.seq) & 1) != 0)
+		omni_thread::yield();
+	CACHE_BARRIER();
+	return s;
+}
+
+inline bool cache_read_retry(const CacheDataBlock &cdb,unsigned long s)
+{
+	CACHE_BARRIER();
+	return cdb.seq != s;
+}
+
+// Monotonic clock of the cache dates (us)
+long long cache_clock_us();
+
+//
+// Cache schedule of one device connection. The blocks are kept in a
+// priority queue sorted on their next refresh date. The polling pool
+// calls poll() when the first date is reached, one worker at a time.
+//
+
+class CachePoller
 {
 public:
-	CacheThread(vector<CacheDataBlock> &,omni_mutex &,ThreadCmd *,long,Modbus *);
-	~CacheThread() {}
+	CachePoller(vector<CacheDataBlock> &,const vector<unsigned long> &,long,long,ModbusCore *,Modbus *);
+	~CachePoller() {}
+
+	// Refresh the first due block and return the next refresh date
+	double poll();
+
+	// Date of the next refresh (monotonic, sec)
+	double next_date();
+
+	// Read blocks now, out of their schedule
+	void refresh(const vector<unsigned long> &);
+
+	// Connection dedicated to this poller, NULL for the device one
+	ModbusCore *get_core() {return core;}
 
-	void *run_undetached(void *);
-	void start() {start_undetached();}
+	static double now();
 
 protected:
+	typedef pair<double,unsigned long> Refresh;
+
 	vector<CacheDataBlock>		&data_blocks;
-	omni_mutex					&cmd_mutex;
-	ThreadCmd					*th_cmd;
-	unsigned long				sleeping_time_s;
-	unsigned long				sleeping_time_ns;
+	double						default_period;
+	double						max_period;
+	ModbusCore					*core;
 	Modbus						*the_dev;
+	priority_queue<Refresh,vector<Refresh>,greater<Refresh> >	schedule;
+	vector<double>				adapt_period;
+	vector<unsigned long>		nb_unchanged;
+
+	bool read_block(unsigned long);
+
+	friend class PollingPool;
+	volatile long				owner;		// Worker owning this device
+	volatile bool				running;
+	bool						removed;
+	volatile unsigned long		stamp;		// Valid heap entry of the device
+	vector<unsigned long>		urgent;		// Blocks to refresh now
+};
+
+#define POLLING_MAX_THREADS		64
+
+//
+// Mutex and condition whose timed wait runs on the monotonic clock.
+// omni_condition::timedwait() takes a wall clock date, a clock change
+// would delay the polling.
+//
+
+class MonotonicCondition
+{
+public:
+	MonotonicCondition();
+	~MonotonicCondition();
+
+	void lock();
+	void unlock();
+	void wait();
+	// Wait (at most) until a CachePoller::now() date
+	void wait_until(double date);
+	void broadcast();
+
+	class Sync
+	{
+	public:
+		Sync(MonotonicCondition &c):cond(c) {cond.lock();}
+		~Sync() {cond.unlock();}
+	private:
+		MonotonicCondition	&cond;
+	};
+
+private:
+#ifdef _TG_WINDOWS_
+	CRITICAL_SECTION			mutex;
+	CONDITION_VARIABLE			cond;
+#else
+	pthread_mutex_t				mutex;
+	pthread_cond_t				cond;
+#endif
+};
+
+//
+// Process wide pool of threads polling the caches of all the devices.
+// Each device (transport) is owned by one worker, which keeps its
+// devices in a heap sorted on their next refresh date, under its own
+// lock. A worker with nothing due steals the first due device of
+// another worker, the device then belongs to the thief. A device is
+// never polled by two workers at the same time, its transport
+// serialises the reads anyway. The device owner, running flag, stamp
+// and urgent list only change under the lock of its worker.
+//
+
+class PollingPool
+{
+public:
+	// Pool of a device, created by the first device. Start workers up
+	// to nb_threads (never stops any).
+	static PollingPool *acquire(long nb_threads);
+
+	// The last device gone stops the workers and frees the pool
+	static void release();
+
+	static PollingPool *instance() {return _instance;}
+
+	void add(CachePoller *);
+
+	// Return once no worker runs the poller any more
+	void remove(CachePoller *);
+
+	// Ask for a refresh of a block as soon as possible
+	void refresh(CachePoller *,unsigned long block);
+
+	// True for the pool worker threads
+	static bool is_worker(int thread_id);
+
+	// Poller run by the calling worker, NULL for other threads
+	static CachePoller *current_poller();
+
+protected:
+	PollingPool();
+
+	// Heap entry, dropped when the device stamp changed since
+	struct Entry
+	{
+		double			date;
+		CachePoller		*poller;
+		unsigned long	stamp;
+		bool operator>(const Entry &e) const {return date > e.date;}
+	};
+
+	class Worker: public omni_thread
+	{
+	public:
+		Worker(PollingPool *p,long i):pool(p),index(i),running(NULL) {}
+		void *run_undetached(void *) {pool->work(index);return NULL;}
+		void start() {start_undetached();}
+		PollingPool			*pool;
+		long				index;
+		MonotonicCondition	cond;
+		priority_queue<Entry,vector<Entry>,greater<Entry> >	heap;
+		CachePoller			*running;
+	};
+
+	void resize(long nb_threads);
+	void work(long);
+	Worker *lock_owner(CachePoller *);
+	void schedule(Worker *,CachePoller *);
+	CachePoller *pop_due(Worker *,double,double &);
+	CachePoller *steal(long,double);
+
+	static PollingPool			*_instance;
+	static omni_mutex			instance_mutex;
+	static long					nb_users;
+	static int					worker_ids[POLLING_MAX_THREADS];
+	static volatile long		nb_worker_ids;
+
+	Worker						*workers[POLLING_MAX_THREADS];
+	volatile long				nb_workers;
+	volatile bool				stopping;
+	long						next_owner;
+
+	static long worker_index(int thread_id);
 };
 
 } // End of namespace
@@ -43,6 +43,9 @@ static const char *RcsId = "$Id:  $";
 #include "Modbus.h"
 #include "ModbusClass.h"
 //#include "CacheThread.h"
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
 #ifdef _TG_WINDOWS_
 #include <sys/types.h>
 #include <sys/timeb.h>
@@ -79,6 +82,20 @@ static const char *RcsId = "$Id:  $";
 //  ReadWriteRegister              |  read_write_register
 //  PresetSingleRegisterBroadcast  |  preset_single_register_broadcast
 //  ReadExceptionStatus            |  read_exception_status
+//  ReadBlocks                     |  read_blocks
+//  ReadScattered                  |  read_scattered
+//  AsyncWriteStatus               |  async_write_status
+//  ReadFileRecord                 |  read_file_record
+//  WriteFileRecord                |  write_file_record
+//  ReadFifoQueue                  |  read_fifo_queue
+//  ReadFifoQueueTimed             |  read_fifo_queue_timed
+//  SchedulerStatistics            |  scheduler_statistics
+//  CacheStatistics                |  cache_statistics
+//  CachePlan                      |  cache_plan
+//  ReadMaxAge                     |  read_max_age
+//  ReadCacheStatistics            |  read_cache_statistics
+//  ReadHistory                    |  read_history
+//  ReadFifoQueueSince             |  read_fifo_queue_since
 //================================================================
 
 //================================================================
@@ -140,31 +157,65 @@ void Modbus::delete_device()
 	/*----- PROTECTED REGION ID(Modbus::delete_device) ENABLED START -----*/
 	
 	//	Delete device allocated objects
-	if ( theThread )
+
+	// No more refresh requests to the pollers from the writes
+	cacheStopping = true;
+
+	if ( writeThread )
 	{
-		{
-			omni_mutex_lock sync(thCmdMutex);
-			thCmd = SUICIDE;
-		}
+		// The thread writes the queued values before exiting. Its
+		// writes may still ask the pollers for a refresh.
+		writeThread->stop();
 		void *ptr=0;
-		theThread->join(&ptr);
+		writeThread->join(&ptr);
+		writeThread = 0;
 	}
 
-	for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+	for (unsigned long loop = 0;loop < cachePollers.size();loop++)
 	{
-		delete cacheDef[loop].data_block_mutex;
-		if (cacheDef[loop].short_data_cache_ptr)
-		{
-			delete cacheDef[loop].short_data_cache_ptr;
-			cacheDef[loop].short_data_cache_ptr = 0;
-		}
+		// Wait for the pool workers to release the device
+		PollingPool::instance()->remove(cachePollers[loop]);
+		delete cachePollers[loop];
+	}
+	if (cachePollers.empty() == false)
+		PollingPool::release();
+	cachePollers.clear();
+
+	for (unsigned long loop = 0;loop < pollerCores.size();loop++)
+		delete pollerCores[loop];
+	pollerCores.clear();
+
+	if ( cacheSnapshot )
+	{
+		// Unmapping flushes the last values to the file
+		delete cacheSnapshot;
+		cacheSnapshot = 0;
+	}
+
+	if ( readCache )
+	{
+		delete readCache;
+		readCache = 0;
 	}
+
 	cacheDef.clear();
+	cacheRanges.clear();
+	cachePlan.clear();
+	delete [] cacheMutexes;
+	cacheMutexes = 0;
+	delete [] cacheArena;
+	cacheArena = 0;
+	delete [] cacheDates;
+	cacheDates = 0;
+	for (int fc = 0;fc <= READ_FIFO_QUEUE;fc++)
+		cacheIndex[fc].clear();
 
 	if ( modbusCore)
 	{
+		// Stop the scheduler and close the transport
 		delete modbusCore;
 		modbusCore = 0;
+		scheduler = 0;
 	}
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::delete_device
@@ -183,12 +234,25 @@ void Modbus::init_device()
 	
 	//	Initialization before get_device_property() call
 	modbusCore = 0;
-	theThread  = 0;
+	scheduler = 0;
+	cachePollers.clear();
+	pollerCores.clear();
+	cacheStopping = false;
+	cachePlanSeeded = false;
+	writeThread = 0;
+	readCache = 0;
+	cacheSnapshot = 0;
+	cacheMutexes = 0;
+	cacheArena = 0;
+	cacheDates = 0;
 	cacheDef.clear();
-	thId 			 = -1;
-	maxDeltaTh = -1;
 	error_.clear();
-	
+
+	//	Remove the cache attributes created by a previous init
+	for (unsigned long loop = 0;loop < cacheAttNames.size();loop++)
+		remove_attribute(cacheAttNames[loop],true,false);
+	cacheAttNames.clear();
+
 	/*----- PROTECTED REGION END -----*/	//	Modbus::init_device_before
 	
 
@@ -216,7 +280,7 @@ void Modbus::init_device()
 	  	error_ = "Iphost property must be defnied for TCP protocol.\n";
 	  }
 	  else
-	  	modbusCore = new ModbusTCP( iphost , port, address , tCPTimeout , tCPConnectTimeout, tCPNoDelay , tCPQuickAck , tCPKeepAlive);
+	  	modbusCore = new ModbusTCP( iphost , port, address , tCPTimeout , tCPConnectTimeout, tCPNoDelay , tCPQuickAck , tCPKeepAlive , pipelineDepth);
 
 	}
 	else
@@ -224,6 +288,19 @@ void Modbus::init_device()
 		error_ = "Invalid protocol, only RTU or TCP are supported\n";
 	}
 
+	if ( (laneWeights.empty() == false) &&
+	     ((laneWeights.size() != NB_LANES) ||
+	      (*min_element(laneWeights.begin(),laneWeights.end()) <= 0)) )
+	{
+		error_ += "LaneWeights property must contain 3 weights greater than 0.\n";
+	}
+
+	if ( (linkModel.empty() == false) &&
+	     ((linkModel.size() != 2) || (linkModel[0] < 0.0) || (linkModel[1] <= 0.0)) )
+	{
+		error_ += "LinkModel property must contain the latency (ms) and the transfer rate (bytes/s).\n";
+	}
+
 	if ( !error_.empty() )
 	{
 		set_state (Tango::FAULT);
@@ -232,34 +309,77 @@ void Modbus::init_device()
 		return;
 	}
 
+	//
+	// All the exchanges go through the transaction scheduler
+	//
+
+	ModbusCore *controlCore = 0;
+	if ( (controlConnection == true) && (strcasecmp( protocol.c_str() , "TCP" ) == 0) )
+		controlCore = new ModbusTCP( iphost , port, address , tCPTimeout , tCPConnectTimeout, tCPNoDelay , tCPQuickAck , tCPKeepAlive , pipelineDepth);
+
+	vector<long> weights(laneWeights.begin(),laneWeights.end());
+	scheduler = new TransactionScheduler(modbusCore,controlCore,weights);
+	modbusCore = scheduler;
+	scheduler->SetBackgroundThreads(&PollingPool::is_worker);
+
+	//
+	// Link cost model used until the exchanges are measured
+	//
+
+	if (linkModel.empty() == false)
+		linkStats.set_default(linkModel[0] / 1000.0,1.0 / linkModel[1]);
+	else if (strcasecmp(protocol.c_str(),"TCP") == 0)
+		linkStats.set_default(0.001,1.0 / 1000000.0);
+	else
+		linkStats.set_default(0.005,10.0 / 115200.0);
+
 	set_state(Tango::ON);
 
+	//
+	// Read-through cache of the ranges not in CacheConfig
+	//
+
+	if (readCacheSize > 0)
+		readCache = new ReadCache(readCacheSize,readCacheTTL);
+
+	//
+	// Start the asynchronous write thread
+	//
+
+	if (asyncWrite == true)
+	{
+		writeThread = new WriteThread(asyncWritePeriod,this);
+		writeThread->start();
+	}
+
 	//
 	// If the CacheConfig property is defined, check its validity
 	//
 
 	if (cacheConfig.empty() == false)
 	{
-		if ((cacheConfig.size() % 3) != 0)
+		unsigned long idx = 0;
+		while (idx < cacheConfig.size())
 		{
-			error_ += "The device CacheConfig property does not have a correct number of element. Must be a 3 multiple.";
-			set_state (Tango::FAULT);
-			set_status(error_.c_str());
-			//- stop here
-			return;
-		}
+			if ((idx + 3) > cacheConfig.size())
+			{
+				error_ += "The device CacheConfig property does not have a correct number of element. Must be a 3 multiple (plus the optional periods).";
+				set_state (Tango::FAULT);
+				set_status(error_.c_str());
+				//- stop here
+				return;
+			}
 
-		long cached_block_nb = cacheConfig.size() / 3;
-		for (long i = 0;i < cached_block_nb;i++)
-		{
-			string cmd = cacheConfig[i * 3];
+			string cmd = cacheConfig[idx];
 			transform(cmd.begin(),cmd.end(),cmd.begin(),::tolower);
 			if ((cmd != "readholdingregisters") &&
 				(cmd != "readinputregisters") &&
-				(cmd != "readmultiplecoilsstatus"))
+				(cmd != "readmultiplecoilsstatus") &&
+				(cmd != "readinputstatus") &&
+				(cmd != "readfifoqueue"))
 			{
       				char tmp[256];
-      				sprintf(tmp,"The command %s is not supported to cache data",cacheConfig[i * 3].c_str());
+      				sprintf(tmp,"The command %s is not supported to cache data",cacheConfig[idx].c_str());
       				error_ = tmp;
 						set_state (Tango::FAULT);
 						set_status(error_.c_str());
@@ -271,12 +391,12 @@ void Modbus::init_device()
 			// Check address definition
 			//
 
-			for (unsigned int j = 0;j < cacheConfig[(i * 3) + 1].size();j++)
+			for (unsigned int j = 0;j < cacheConfig[idx + 1].size();j++)
 			{
-				if (isdigit(cacheConfig[(i * 3) + 1][j]) == 0)
+				if (isdigit(cacheConfig[idx + 1][j]) == 0)
 				{
       				char tmp[256];
-      				sprintf(tmp,"The string %s is not a valid address specification",cacheConfig[(i * 3) + 1].c_str());
+      				sprintf(tmp,"The string %s is not a valid address specification",cacheConfig[idx + 1].c_str());
       				error_ = tmp;
 						set_state (Tango::FAULT);
 						set_status(error_.c_str());
@@ -284,60 +404,278 @@ void Modbus::init_device()
 						return;
 				}
 			}
-			short adr = (short)atoi(cacheConfig[(i * 3) + 1].c_str());
+			long adr = strtol(cacheConfig[idx + 1].c_str(),NULL,10);
+			if (adr > 65535)
+			{
+				char tmp[256];
+				sprintf(tmp,"The address %s is out of range (0..65535)",cacheConfig[idx + 1].c_str());
+				error_ = tmp;
+				set_state (Tango::FAULT);
+				set_status(error_.c_str());
+				//- stop here
+				return;
+			}
 
 			//
 			// Check data_nb definition
 			//
 
-			for (unsigned int j = 0;j < cacheConfig[(i * 3) + 2].size();j++)
+			for (unsigned int j = 0;j < cacheConfig[idx + 2].size();j++)
 			{
-				if (isdigit(cacheConfig[(i * 3) + 2][j]) == 0)
+				if (isdigit(cacheConfig[idx + 2][j]) == 0)
 				{
       				char tmp[256];
-      				sprintf(tmp,"The string %s is not a valid data number specification",cacheConfig[(i * 3) + 2].c_str());
+      				sprintf(tmp,"The string %s is not a valid data number specification",cacheConfig[idx + 2].c_str());
+
+      				error_ = tmp;
+						set_state (Tango::FAULT);
+						set_status(error_.c_str());
+						//- stop here
+						return;
+				}
+			}
+			long nb_data = strtol(cacheConfig[idx + 2].c_str(),NULL,10);
+			if ((cmd == "readfifoqueue") && ((nb_data <= 0) || (nb_data > SHRT_MAX)))
+			{
+				error_ = "The ring size of a ReadFifoQueue cache block must be between 1 and 32767";
+				set_state (Tango::FAULT);
+				set_status(error_.c_str());
+				//- stop here
+				return;
+			}
+			//	The blocks are read in several frames when needed, the
+			//	read commands take up to 32767 data
+			if ((cmd != "readfifoqueue") && ((nb_data <= 0) || (nb_data > SHRT_MAX) || (adr + nb_data > 65536)))
+			{
+				char tmp[256];
+				sprintf(tmp,"The data number %s at address %ld is out of range (1..32767, up to address 65535)",cacheConfig[idx + 2].c_str(),adr);
+				error_ = tmp;
+				set_state (Tango::FAULT);
+				set_status(error_.c_str());
+				//- stop here
+				return;
+			}
+			idx += 3;
+
+			//
+			// Optional refresh period and phase (period[:phase] in ms).
+			// A command name never starts with a digit.
+			//
 
+			long period = 0;
+			long phase = 0;
+			if ((idx < cacheConfig.size()) && (isdigit(cacheConfig[idx][0]) != 0))
+			{
+				char c1 = 0,c2 = 0;
+				int nb = sscanf(cacheConfig[idx].c_str(),"%ld%c%ld%c",&period,&c1,&phase,&c2);
+				if ((period <= 0) || (phase < 0) || ((nb != 1) && ((nb != 3) || (c1 != ':'))))
+				{
+      				char tmp[256];
+      				sprintf(tmp,"The string %s is not a valid period[:phase] specification",cacheConfig[idx].c_str());
       				error_ = tmp;
 						set_state (Tango::FAULT);
 						set_status(error_.c_str());
 						//- stop here
 						return;
 				}
+				idx++;
 			}
-			short nb_data = (short)atoi(cacheConfig[(i * 3) + 2].c_str());
 
 			CacheDataBlock cdb;
-			cdb.cmd_name = cmd;
-			cdb.in_args.length(2);
-			cdb.in_args[0] = adr;
-			cdb.in_args[1] = nb_data;
+			if (cmd == "readholdingregisters")
+				cdb.fc = READ_HOLDING_REGISTERS;
+			else if (cmd == "readinputregisters")
+				cdb.fc = READ_INPUT_REGISTERS;
+			else if (cmd == "readmultiplecoilsstatus")
+				cdb.fc = READ_COIL_STATUS;
+			else if (cmd == "readinputstatus")
+				cdb.fc = READ_INPUT_STATUS;
+			else
+				cdb.fc = READ_FIFO_QUEUE;
+			cdb.adr = adr;
+			cdb.nb = nb_data;
 			cdb.err = false;
-			cdb.nb_sec = 0;
-			cdb.data_block_mutex = new omni_mutex;
-			cdb.short_data_cache_ptr = new short [nb_data];
-			
+			cdb.date_us = 0;
+			cdb.latency_us = 0;
+			cdb.stale = false;
+			cdb.write_us = 0;
+			cdb.period = period;
+			cdb.phase = phase;
+			cdb.seq = 0;
+			memset(&cdb.timing,0,sizeof(cdb.timing));
+			cdb.data_block_mutex = 0;
+			cdb.short_data_cache_ptr = 0;
+			cdb.event_data_ptr = 0;
+			cdb.fifo_time_ptr = 0;
+			cdb.event_valid = false;
+			cdb.event_err = false;
+			cdb.fifo_write = 0;
+			cdb.history_ptr = 0;
+			cdb.history_time_ptr = 0;
+			cdb.history_write = 0;
+
 			cacheDef.push_back(cdb);
 		}
 
+		//
+		// The configured blocks are the ranges to cache. With CacheOptimize,
+		// poll the best set of blocks covering them instead. Planned with
+		// the default link model, they are planned again once the link
+		// is measured (see replan_cache).
+		//
+
+		vector<CacheDataBlock> ranges(cacheDef);
+		if (cacheOptimize == true)
+		{
+			cacheDef.clear();
+			optimize_cache_config(ranges,cacheDef);
+			if (linkStats.is_fitted() == false)
+			{
+				cacheRanges = ranges;
+				cachePlanSeeded = true;
+			}
+		}
+
+		//
+		// The block buffers (data, events and history) share one arena
+		// and the dates (FIFO ring and history) another one, each buffer
+		// starting on a cache line. The block mutexes are one array.
+		// The arenas are sized first, then cut.
+		//
+
+		long depth = (cacheHistoryDepth > 0) ? cacheHistoryDepth : 0;
+		size_t nb_words = 0;
+		size_t nb_dates = 0;
+		for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+		{
+			CacheDataBlock &cdb = cacheDef[loop];
+			nb_words += cache_line_round(cache_words(cdb),sizeof(short));
+			if (cdb.fc == READ_FIFO_QUEUE)
+			{
+				// The data cache is the ring of drained samples
+				nb_dates += cache_line_round(cdb.nb,sizeof(double));
+				continue;
+			}
+			if (cacheEvents == true)
+				nb_words += cache_line_round(cdb.nb,sizeof(short));
+			if (depth != 0)
+			{
+				nb_words += cache_line_round(cache_words(cdb) * depth,sizeof(short));
+				nb_dates += cache_line_round(depth,sizeof(double));
+			}
+		}
+
+		cacheMutexes = new omni_mutex [cacheDef.size()];
+		cacheArena = new short [nb_words + CACHE_LINE_SIZE / sizeof(short)];
+		cacheDates = new double [nb_dates + CACHE_LINE_SIZE / sizeof(double)];
+		short *words = (short *)cache_line_align(cacheArena);
+		double *dates = (double *)cache_line_align(cacheDates);
+
+		for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+		{
+			CacheDataBlock &cdb = cacheDef[loop];
+			cdb.data_block_mutex = &cacheMutexes[loop];
+			cdb.short_data_cache_ptr = words;
+			words += cache_line_round(cache_words(cdb),sizeof(short));
+			if (cdb.fc == READ_FIFO_QUEUE)
+			{
+				cdb.fifo_time_ptr = dates;
+				dates += cache_line_round(cdb.nb,sizeof(double));
+				continue;
+			}
+			if (cacheEvents == true)
+			{
+				cdb.event_data_ptr = words;
+				words += cache_line_round(cdb.nb,sizeof(short));
+			}
+			if (depth != 0)
+			{
+				cdb.history_ptr = words;
+				words += cache_line_round(cache_words(cdb) * depth,sizeof(short));
+				cdb.history_time_ptr = dates;
+				dates += cache_line_round(depth,sizeof(double));
+			}
+		}
+
 		//
 		// Compute threshold to decide that the acquisition thread is dead
 		// The (3 * 2) comes from the TCP connection algorithum which sometimes
-		// wait 2 times for 2 sec
+		// wait 2 times for 2 sec. A block with its own period is checked
+		// against its period (and phase for the first read), or against
+		// CacheMaxPeriod with adaptive polling.
 		//
 
-		Tango::DevLong cacheSleep_sec = cacheSleep / 1000;
-		if (cacheSleep_sec < 1)
-			cacheSleep_sec = 1;
-		maxDeltaTh = (3 * 2) + cacheSleep_sec * 3 + (Tango::DevLong)(cacheDef.size() * tCPTimeout + 0.5);
+		for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+		{
+			long long period_ms = cacheDef[loop].period + cacheDef[loop].phase;
+			if (period_ms < cacheSleep)
+				period_ms = cacheSleep;
+			if ((cacheDef[loop].fc != READ_FIFO_QUEUE) && (period_ms < cacheMaxPeriod + cacheDef[loop].phase))
+				period_ms = cacheMaxPeriod + cacheDef[loop].phase;
+			if (period_ms < 1000)
+				period_ms = 1000;
+			cacheDef[loop].max_age_us = ((3 * 2) * 1000 + period_ms * 3 +
+				(long long)(cacheDef.size() * tCPTimeout * 1000.0 + 0.5)) * 1000;
+		}
+
+		build_cache_index();
+		build_cache_plan(ranges);
+
+		//
+		// Serve the values saved by the previous run until the first
+		// refresh. The cache works without snapshot if the file cannot
+		// be used.
+		//
+
+		if (cacheSnapshotFile.empty() == false)
+		{
+			try
+			{
+				cacheSnapshot = new CacheSnapshot(cacheSnapshotFile,cacheDef);
+				long nb_loaded = cacheSnapshot->load(cacheSnapshotMaxAge);
+				INFO_STREAM << nb_loaded << " cache blocks loaded from " << cacheSnapshotFile << endl;
+			}
+			catch (Tango::DevFailed &e)
+			{
+				ERROR_STREAM << e.errors[0].desc << endl;
+			}
+		}
+
+		//
+		// Create the cache attributes before the thread starts pushing
+		// events on them
+		//
+
+		add_dynamic_attributes();
 
 		//
-		// Start thread
+		// Give the cache to the polling pool. With several polling
+		// connections, the blocks are spread over them and each one
+		// has its own poller so that they are read concurrently.
 		//
 
-		thCmd = RUN;
-		theThread = new CacheThread(cacheDef,thCmdMutex,&thCmd,cacheSleep,this);
-		theThread->start();
-		thId = theThread->id();
+		PollingPool *pool = PollingPool::acquire((pollingThreads > 0) ? pollingThreads : 1);
+
+		long nb_conn = 1;
+		if ((pollingConnections > 1) && (strcasecmp(protocol.c_str(),"TCP") == 0))
+			nb_conn = min((long)pollingConnections,(long)cacheDef.size());
+
+		vector< vector<unsigned long> > conn_blocks(nb_conn);
+		for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+			conn_blocks[loop % nb_conn].push_back(loop);
+
+		for (long conn = 0;conn < nb_conn;conn++)
+		{
+			ModbusCore *core = 0;
+			if (nb_conn > 1)
+			{
+				core = new ModbusTCP( iphost , port, address , tCPTimeout , tCPConnectTimeout, tCPNoDelay , tCPQuickAck , tCPKeepAlive , pipelineDepth);
+				pollerCores.push_back(core);
+			}
+			CachePoller *poller = new CachePoller(cacheDef,conn_blocks[conn],cacheSleep,cacheMaxPeriod,core,this);
+			cachePollers.push_back(poller);
+			pool->add(poller);
+		}
 	}
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::init_device
@@ -367,6 +705,22 @@ void Modbus::get_device_property()
 	tCPQuickAck= false;
 	numberOfRetry = 1;
 	sleepBetweenRetry = 1;
+	pipelineDepth = 1;
+	asyncWrite = false;
+	asyncWritePeriod = 20;
+	controlConnection = false;
+	laneWeights.clear();
+	linkModel.clear();
+	cacheOptimize = false;
+	readCacheSize = 0;
+	readCacheTTL = 1000;
+	cacheMaxPeriod = 0;
+	pollingThreads = 1;
+	pollingConnections = 1;
+	cacheHistoryDepth = 0;
+	cacheRefreshOnWrite = false;
+	cacheSnapshotMaxAge = 3600;
+	cacheSnapshotServeStale = false;
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::get_device_property_before
 
@@ -388,6 +742,26 @@ void Modbus::get_device_property()
 	dev_prop.push_back(Tango::DbDatum("SleepBetweenRetry"));
 	dev_prop.push_back(Tango::DbDatum("TCPKeepAlive"));
 	dev_prop.push_back(Tango::DbDatum("Port"));
+	dev_prop.push_back(Tango::DbDatum("CacheEvents"));
+	dev_prop.push_back(Tango::DbDatum("CacheEventAbsChange"));
+	dev_prop.push_back(Tango::DbDatum("CacheEventRelChange"));
+	dev_prop.push_back(Tango::DbDatum("PipelineDepth"));
+	dev_prop.push_back(Tango::DbDatum("AsyncWrite"));
+	dev_prop.push_back(Tango::DbDatum("AsyncWritePeriod"));
+	dev_prop.push_back(Tango::DbDatum("ControlConnection"));
+	dev_prop.push_back(Tango::DbDatum("LaneWeights"));
+	dev_prop.push_back(Tango::DbDatum("CacheOptimize"));
+	dev_prop.push_back(Tango::DbDatum("ReadCacheSize"));
+	dev_prop.push_back(Tango::DbDatum("ReadCacheTTL"));
+	dev_prop.push_back(Tango::DbDatum("CacheMaxPeriod"));
+	dev_prop.push_back(Tango::DbDatum("PollingThreads"));
+	dev_prop.push_back(Tango::DbDatum("PollingConnections"));
+	dev_prop.push_back(Tango::DbDatum("CacheSnapshotFile"));
+	dev_prop.push_back(Tango::DbDatum("CacheHistoryDepth"));
+	dev_prop.push_back(Tango::DbDatum("CacheRefreshOnWrite"));
+	dev_prop.push_back(Tango::DbDatum("CacheSnapshotMaxAge"));
+	dev_prop.push_back(Tango::DbDatum("CacheSnapshotServeStale"));
+	dev_prop.push_back(Tango::DbDatum("LinkModel"));
 
 	//	is there at least one property to be read ?
 	if (dev_prop.size()>0)
@@ -566,6 +940,226 @@ void Modbus::get_device_property()
 		//	And try to extract Port value from database
 		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  port;
 
+		//	Try to initialize CacheEvents from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheEvents;
+		else {
+			//	Try to initialize CacheEvents from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheEvents;
+		}
+		//	And try to extract CacheEvents value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheEvents;
+
+		//	Try to initialize CacheEventAbsChange from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheEventAbsChange;
+		else {
+			//	Try to initialize CacheEventAbsChange from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheEventAbsChange;
+		}
+		//	And try to extract CacheEventAbsChange value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheEventAbsChange;
+
+		//	Try to initialize CacheEventRelChange from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheEventRelChange;
+		else {
+			//	Try to initialize CacheEventRelChange from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheEventRelChange;
+		}
+		//	And try to extract CacheEventRelChange value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheEventRelChange;
+
+		//	Try to initialize PipelineDepth from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  pipelineDepth;
+		else {
+			//	Try to initialize PipelineDepth from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  pipelineDepth;
+		}
+		//	And try to extract PipelineDepth value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  pipelineDepth;
+
+		//	Try to initialize AsyncWrite from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  asyncWrite;
+		else {
+			//	Try to initialize AsyncWrite from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  asyncWrite;
+		}
+		//	And try to extract AsyncWrite value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  asyncWrite;
+
+		//	Try to initialize AsyncWritePeriod from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  asyncWritePeriod;
+		else {
+			//	Try to initialize AsyncWritePeriod from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  asyncWritePeriod;
+		}
+		//	And try to extract AsyncWritePeriod value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  asyncWritePeriod;
+
+		//	Try to initialize ControlConnection from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  controlConnection;
+		else {
+			//	Try to initialize ControlConnection from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  controlConnection;
+		}
+		//	And try to extract ControlConnection value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  controlConnection;
+
+		//	Try to initialize LaneWeights from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  laneWeights;
+		else {
+			//	Try to initialize LaneWeights from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  laneWeights;
+		}
+		//	And try to extract LaneWeights value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  laneWeights;
+
+		//	Try to initialize CacheOptimize from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheOptimize;
+		else {
+			//	Try to initialize CacheOptimize from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheOptimize;
+		}
+		//	And try to extract CacheOptimize value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheOptimize;
+
+		//	Try to initialize ReadCacheSize from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  readCacheSize;
+		else {
+			//	Try to initialize ReadCacheSize from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  readCacheSize;
+		}
+		//	And try to extract ReadCacheSize value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  readCacheSize;
+
+		//	Try to initialize ReadCacheTTL from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  readCacheTTL;
+		else {
+			//	Try to initialize ReadCacheTTL from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  readCacheTTL;
+		}
+		//	And try to extract ReadCacheTTL value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  readCacheTTL;
+
+		//	Try to initialize CacheMaxPeriod from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheMaxPeriod;
+		else {
+			//	Try to initialize CacheMaxPeriod from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheMaxPeriod;
+		}
+		//	And try to extract CacheMaxPeriod value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheMaxPeriod;
+
+		//	Try to initialize PollingThreads from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  pollingThreads;
+		else {
+			//	Try to initialize PollingThreads from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  pollingThreads;
+		}
+		//	And try to extract PollingThreads value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  pollingThreads;
+
+		//	Try to initialize PollingConnections from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  pollingConnections;
+		else {
+			//	Try to initialize PollingConnections from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  pollingConnections;
+		}
+		//	And try to extract PollingConnections value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  pollingConnections;
+
+		//	Try to initialize CacheSnapshotFile from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheSnapshotFile;
+		else {
+			//	Try to initialize CacheSnapshotFile from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheSnapshotFile;
+		}
+		//	And try to extract CacheSnapshotFile value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheSnapshotFile;
+
+		//	Try to initialize CacheHistoryDepth from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheHistoryDepth;
+		else {
+			//	Try to initialize CacheHistoryDepth from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheHistoryDepth;
+		}
+		//	And try to extract CacheHistoryDepth value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheHistoryDepth;
+
+		//	Try to initialize CacheRefreshOnWrite from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheRefreshOnWrite;
+		else {
+			//	Try to initialize CacheRefreshOnWrite from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheRefreshOnWrite;
+		}
+		//	And try to extract CacheRefreshOnWrite value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheRefreshOnWrite;
+
+		//	Try to initialize CacheSnapshotMaxAge from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheSnapshotMaxAge;
+		else {
+			//	Try to initialize CacheSnapshotMaxAge from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheSnapshotMaxAge;
+		}
+		//	And try to extract CacheSnapshotMaxAge value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheSnapshotMaxAge;
+
+		//	Try to initialize CacheSnapshotServeStale from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  cacheSnapshotServeStale;
+		else {
+			//	Try to initialize CacheSnapshotServeStale from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  cacheSnapshotServeStale;
+		}
+		//	And try to extract CacheSnapshotServeStale value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  cacheSnapshotServeStale;
+
+		//	Try to initialize LinkModel from class property
+		cl_prop = ds_class->get_class_property(dev_prop[++i].name);
+		if (cl_prop.is_empty()==false)	cl_prop  >>  linkModel;
+		else {
+			//	Try to initialize LinkModel from default device value
+			def_prop = ds_class->get_default_device_property(dev_prop[i].name);
+			if (def_prop.is_empty()==false)	def_prop  >>  linkModel;
+		}
+		//	And try to extract LinkModel value from database
+		if (dev_prop[i].is_empty()==false)	dev_prop[i]  >>  linkModel;
+
 	}
 
 	/*----- PROTECTED REGION ID(Modbus::get_device_property_after) ENABLED START -----*/
@@ -664,42 +1258,162 @@ void Modbus::get_device_property()
     prop  <<  port;
     data_put.push_back(prop);
   }
-
-  //- write default property if created
-  if( !data_put.empty() )
-    get_db_device()->put_property(data_put);
-
-	
-	/*----- PROTECTED REGION END -----*/	//	Modbus::get_device_property_after
-}
-
-//--------------------------------------------------------
-/**
- *	Method      : Modbus::always_executed_hook()
- *	Description : method always executed before any command is executed
- */
-//--------------------------------------------------------
-void Modbus::always_executed_hook()
-{
-	DEBUG_STREAM << "Modbus::always_executed_hook()  " << device_name << endl;
-	/*----- PROTECTED REGION ID(Modbus::always_executed_hook) ENABLED START -----*/
-	
-	//	code always executed before all requests
-	if ( get_state() != Tango::FAULT )
-	{
-		set_status(modbusCore->Status());
-		set_state(modbusCore->State());
-	}
-	/*----- PROTECTED REGION END -----*/	//	Modbus::always_executed_hook
-}
-
-//--------------------------------------------------------
-/**
- *	Method      : Modbus::read_attr_hardware()
- *	Description : Hardware acquisition for attributes
- */
-//--------------------------------------------------------
-void Modbus::read_attr_hardware(TANGO_UNUSED(vector<long> &attr_list))
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheEvents");
+    prop  <<  cacheEvents;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheEventAbsChange");
+    prop  <<  cacheEventAbsChange;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheEventRelChange");
+    prop  <<  cacheEventRelChange;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("PipelineDepth");
+    prop  <<  pipelineDepth;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("AsyncWrite");
+    prop  <<  asyncWrite;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("AsyncWritePeriod");
+    prop  <<  asyncWritePeriod;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("ControlConnection");
+    prop  <<  controlConnection;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("LaneWeights");
+    prop  <<  laneWeights;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheOptimize");
+    prop  <<  cacheOptimize;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("ReadCacheSize");
+    prop  <<  readCacheSize;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("ReadCacheTTL");
+    prop  <<  readCacheTTL;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheMaxPeriod");
+    prop  <<  cacheMaxPeriod;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("PollingThreads");
+    prop  <<  pollingThreads;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("PollingConnections");
+    prop  <<  pollingConnections;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheSnapshotFile");
+    prop  <<  cacheSnapshotFile;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheHistoryDepth");
+    prop  <<  cacheHistoryDepth;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheRefreshOnWrite");
+    prop  <<  cacheRefreshOnWrite;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheSnapshotMaxAge");
+    prop  <<  cacheSnapshotMaxAge;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("CacheSnapshotServeStale");
+    prop  <<  cacheSnapshotServeStale;
+    data_put.push_back(prop);
+  }
+  if ( dev_prop[++idx].is_empty() )
+  {
+    Tango::DbDatum  prop("LinkModel");
+    prop  <<  linkModel;
+    data_put.push_back(prop);
+  }
+
+  //- write default property if created
+  if( !data_put.empty() )
+    get_db_device()->put_property(data_put);
+
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::get_device_property_after
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::always_executed_hook()
+ *	Description : method always executed before any command is executed
+ */
+//--------------------------------------------------------
+void Modbus::always_executed_hook()
+{
+	DEBUG_STREAM << "Modbus::always_executed_hook()  " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::always_executed_hook) ENABLED START -----*/
+	
+	//	code always executed before all requests
+	if ( get_state() != Tango::FAULT )
+	{
+		set_status(modbusCore->Status());
+		set_state(modbusCore->State());
+	}
+	/*----- PROTECTED REGION END -----*/	//	Modbus::always_executed_hook
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::read_attr_hardware()
+ *	Description : Hardware acquisition for attributes
+ */
+//--------------------------------------------------------
+void Modbus::read_attr_hardware(TANGO_UNUSED(vector<long> &attr_list))
 {
 	DEBUG_STREAM << "Modbus::read_attr_hardware(vector<long> &attr_list) entering... " << endl;
 	/*----- PROTECTED REGION ID(Modbus::read_attr_hardware) ENABLED START -----*/
@@ -722,10 +1436,65 @@ void Modbus::add_dynamic_attributes()
 	/*----- PROTECTED REGION ID(Modbus::add_dynamic_attributes) ENABLED START -----*/
 	
 	//	Add your own code to create and add dynamic attributes if any
-	
+
+	//	One CacheBlock attribute per cached block. This method is called
+	//	from init_device() and from the device factory, create them once.
+	if (cacheAttNames.empty() == false)
+		return;
+
+	for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+	{
+		stringstream ss;
+		ss << "CacheBlock" << loop;
+		string att_name = ss.str();
+
+		CacheBlockAttrib *att = new CacheBlockAttrib(att_name,loop,cacheDef[loop].nb);
+		Tango::UserDefaultAttrProp att_prop;
+		stringstream desc;
+		desc << "Cached data read with " << cache_cmd_name(cacheDef[loop].fc) << " from address "
+		     << cacheDef[loop].adr << " (" << cacheDef[loop].nb << " data)";
+		att_prop.set_description(desc.str().c_str());
+		att->set_default_properties(att_prop);
+		if (cacheEvents == true)
+		{
+			//	Events are pushed by the cache thread, no change detection by Tango
+			att->set_change_event(true,false);
+			att->set_archive_event(true,false);
+		}
+		add_attribute(att);
+		cacheAttNames.push_back(att_name);
+	}
+
 	/*----- PROTECTED REGION END -----*/	//	Modbus::add_dynamic_attributes
 }
 
+//--------------------------------------------------------
+/**
+ *	Read attribute CacheBlock related method
+ *	Description: Data of one CacheConfig block (one attribute per block)
+ *
+ *	Data type:	Tango::DevShort
+ *	Attr type:	Spectrum max = number of data in the block
+ */
+//--------------------------------------------------------
+void Modbus::read_CacheBlock(Tango::Attribute &attr,long block)
+{
+	DEBUG_STREAM << "Modbus::read_CacheBlock(Tango::Attribute &attr) entering... " << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_CacheBlock) ENABLED START -----*/
+
+	//	Served from the cache when the thread already filled the block
+	Tango::DevVarShortArray *dvsa = read_cache_block(block);
+	long nb_data = dvsa->length();
+	attr.set_value(dvsa->get_buffer(true),nb_data,0,true);
+	delete dvsa;
+
+	//	Value loaded from the snapshot and not read since the start
+	if (cacheDef[block].stale == true)
+		attr.set_quality(Tango::ATTR_INVALID);
+
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_CacheBlock
+}
+
 //--------------------------------------------------------
 /**
  *	Command ForceSingleCoil related method
@@ -747,6 +1516,12 @@ void Modbus::force_single_coil(const Tango::DevVarShortArray *argin)
         coil_address = (*argin)[0];
         coil_value = (*argin)[1];
 
+	if (writeThread != 0)
+	{
+	  writeThread->write_coil((unsigned short)coil_address,coil_value);
+	  return;
+	}
+
 	query[0] = FORCE_SINGLE_COIL;
 	query[1] = coil_address >> 8;
 	query[2] = coil_address & 0xff;
@@ -790,12 +1565,17 @@ Tango::DevShort Modbus::read_coil_status(Tango::DevShort argin)
         coil_address = argin;
         no_coils = 1;
         
-        int data_block = get_data_block("readmultiplecoilsstatus",coil_address,no_coils);
-        
-        if (data_block == -1) {
+        int data_block = get_data_block(READ_COIL_STATUS,coil_address,no_coils);
+        Tango::DevVarShortArray *lru = 0;
+        unsigned long cache_gen = 0;
+        if (data_block == -1)
+            lru = read_cache_get(READ_COIL_STATUS,coil_address,no_coils,cache_gen);
+
+        if (lru != 0) {
+            argout = (*lru)[0];
+            delete lru;
+        } else if (data_block == -1) {
 	
-            omni_mutex_lock sync(this->rmcs_mutex);
-            
             unsigned char query[5], response[MAX_FRAME_SIZE];
 
             query[0] = READ_COIL_STATUS;
@@ -807,6 +1587,11 @@ Tango::DevShort Modbus::read_coil_status(Tango::DevShort argin)
             SendGet(query,5,response,3);
 
             argout = (response[2]!=0)?1:0;
+
+            Tango::DevVarShortArray tmp;
+            tmp.length(1);
+            tmp[0] = argout;
+            read_cache_put(READ_COIL_STATUS,coil_address,no_coils,&tmp,cache_gen);
         } else {
             Tango::DevVarShortArray * tmp  = new Tango::DevVarShortArray();
             get_cache_data(data_block,coil_address,no_coils,tmp);
@@ -839,6 +1624,32 @@ Tango::DevVarCharArray *Modbus::read_input_status(const Tango::DevVarShortArray
 	input_address = (*argin)[0];
 	no_inputs = (*argin)[1];
 
+	int data_block = get_data_block(READ_INPUT_STATUS,input_address,no_inputs);
+
+	if (data_block != -1)
+	{
+	  Tango::DevVarShortArray *tmp = new Tango::DevVarShortArray();
+	  get_cache_data(data_block,input_address,no_inputs,tmp);
+	  argout = new Tango::DevVarCharArray();
+	  argout->length(no_inputs);
+	  for (int i = 0;i < no_inputs;i++)
+	    (*argout)[i] = (unsigned char)(*tmp)[i];
+	  delete tmp;
+	  return argout;
+	}
+
+	unsigned long cache_gen = 0;
+	Tango::DevVarShortArray *lru = read_cache_get(READ_INPUT_STATUS,input_address,no_inputs,cache_gen);
+	if (lru != 0)
+	{
+	  argout = new Tango::DevVarCharArray();
+	  argout->length(no_inputs);
+	  for (int i = 0;i < no_inputs;i++)
+	    (*argout)[i] = (unsigned char)(*lru)[i];
+	  delete lru;
+	  return argout;
+	}
+
     	query[0] = READ_INPUT_STATUS;
     	query[1] = input_address >> 8;
     	query[2] = input_address & 0xff;
@@ -856,6 +1667,15 @@ Tango::DevVarCharArray *Modbus::read_input_status(const Tango::DevVarShortArray
 	  byteidx = i/8 + 2;
 	  (*argout)[i] = (response[byteidx] & bitmask)?1:0;
 	}
+
+	if (readCache != 0)
+	{
+	  Tango::DevVarShortArray tmp;
+	  tmp.length(no_inputs);
+	  for (int i = 0;i < no_inputs;i++)
+	    tmp[i] = (*argout)[i];
+	  read_cache_put(READ_INPUT_STATUS,input_address,no_inputs,&tmp,cache_gen);
+	}
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::read_input_status
 	return argout;
@@ -884,13 +1704,16 @@ Tango::DevVarShortArray *Modbus::read_holding_registers(const Tango::DevVarShort
 	register_address = (*argin)[0];
 	no_registers = (*argin)[1];
 
-	int data_block = get_data_block("readholdingregisters",register_address,no_registers);
+	int data_block = get_data_block(READ_HOLDING_REGISTERS,register_address,no_registers);
+
+	unsigned long cache_gen = 0;
+	if ((data_block == -1) &&
+	    ((argout = read_cache_get(READ_HOLDING_REGISTERS,register_address,no_registers,cache_gen)) != 0))
+	  return argout;
 
 	if (data_block == -1)
 	{
 
-	  omni_mutex_lock sync(this->rhr_mutex);
-
 	  int index = 0;
 
 	  // Do as many readouts as required (120 registers max per frame)
@@ -925,6 +1748,7 @@ Tango::DevVarShortArray *Modbus::read_holding_registers(const Tango::DevVarShort
 	  argout->length(registers.size());
 	  for(size_t i=0;i<registers.size();i++)
 	    (*argout)[i] = registers[i];
+	  read_cache_put(READ_HOLDING_REGISTERS,(*argin)[0],(*argin)[1],argout,cache_gen);
 
 	} else {
           argout  = new Tango::DevVarShortArray();
@@ -958,13 +1782,16 @@ Tango::DevVarShortArray *Modbus::read_input_registers(const Tango::DevVarShortAr
 	register_address = (*argin)[0];
 	no_registers = (*argin)[1];
 
-	int data_block = get_data_block("readinputregisters",register_address,no_registers);
+	int data_block = get_data_block(READ_INPUT_REGISTERS,register_address,no_registers);
+
+	unsigned long cache_gen = 0;
+	if ((data_block == -1) &&
+	    ((argout = read_cache_get(READ_INPUT_REGISTERS,register_address,no_registers,cache_gen)) != 0))
+	  return argout;
 
 	if (data_block == -1)
 	{
 
-	  omni_mutex_lock sync(this->rir_mutex);
-
 	  int index = 0;
 
 	  // Do as many readouts as required (120 registers max per frame)
@@ -999,6 +1826,7 @@ Tango::DevVarShortArray *Modbus::read_input_registers(const Tango::DevVarShortAr
 	  argout->length(registers.size());
 	  for(size_t i=0;i<registers.size();i++)
 	    (*argout)[i] = registers[i];
+	  read_cache_put(READ_INPUT_REGISTERS,(*argin)[0],(*argin)[1],argout,cache_gen);
 
 	} else {
           argout  = new Tango::DevVarShortArray();
@@ -1028,6 +1856,12 @@ void Modbus::preset_single_register(const Tango::DevVarShortArray *argin)
 	check_argin(argin,2,"Modbus::preset_single_register");
 	register_address = (*argin)[0];
 	value = (*argin)[1];
+
+	if (writeThread != 0)
+	{
+	  writeThread->write_register((unsigned short)register_address,value);
+	  return;
+	}
 	
 	query[0] = PRESET_SINGLE_REGISTER;
 	query[1] = register_address >> 8;
@@ -1084,8 +1918,7 @@ void Modbus::force_multiple_coils(const Tango::DevVarShortArray *argin)
 	DEBUG_STREAM << "Modbus::ForceMultipleCoils()  - " << device_name << endl;
 	/*----- PROTECTED REGION ID(Modbus::force_multiple_coils) ENABLED START -----*/
 	
-	short coil_address, no_coils, no_bytes, byteidx;
-	unsigned char bitmask, query[1024], response[1024];
+	short coil_address, no_coils;
 	
 	if(argin->length()<3) {
 	  Tango::Except::throw_exception(
@@ -1099,22 +1932,35 @@ void Modbus::force_multiple_coils(const Tango::DevVarShortArray *argin)
 	
 	check_argin(argin,2+no_coils,"Modbus::force_multiple_coils");
 
-	memset(query,0,1024);
-	query[0] = FORCE_MULTIPLE_COILS;
-	query[1] = coil_address >> 8;
-	query[2] = coil_address & 0xff;
-	query[3] = no_coils >> 8;
-	query[4] = no_coils & 0xff;
-	query[5] = (no_coils+7)/8;
-	for (int i=0; i<no_coils; i++) {
-	  bitmask = (1 << (i%8));
-	  byteidx = i/8 + 6;
-	  if((*argin)[2+i])
-	    query[byteidx] |= bitmask;
+	// Split in frames of 1968 coils max
+	vector<ModbusRequest> requests;
+	for (long done = 0;done < no_coils;)
+	{
+	  long nb = ((no_coils - done) > MAX_NB_WRITE_COIL) ? MAX_NB_WRITE_COIL : (no_coils - done);
+	  short adr = coil_address + done;
+	  ModbusRequest req;
+
+	  memset(req.query,0,MAX_FRAME_SIZE);
+	  req.query[0] = FORCE_MULTIPLE_COILS;
+	  req.query[1] = adr >> 8;
+	  req.query[2] = adr & 0xff;
+	  req.query[3] = nb >> 8;
+	  req.query[4] = nb & 0xff;
+	  req.query[5] = (nb+7)/8;
+	  for (long i=0; i<nb; i++) {
+	    if((*argin)[2+done+i])
+	      req.query[i/8 + 6] |= (1 << (i%8));
+	  }
+	  req.query_length = 6+(nb+7)/8;
+	  req.response_length = 5;
+	  req.done = false;
+	  req.sent = false;
+
+	  requests.push_back(req);
+	  done += nb;
 	}
-	no_bytes = 6+(no_coils+7)/8;
 
-        SendGet(query,no_bytes,response,5);
+	write_frames(requests,"Modbus::force_multiple_coils");
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::force_multiple_coils
 }
@@ -1143,11 +1989,14 @@ Tango::DevVarShortArray *Modbus::read_multiple_coils_status(const Tango::DevVarS
 	coil_address = (*argin)[0];
 	no_coils     = (*argin)[1];
 
-	int data_block = get_data_block("readmultiplecoilsstatus",coil_address,no_coils);
+	int data_block = get_data_block(READ_COIL_STATUS,coil_address,no_coils);
 
-	if (data_block == -1) {
+	unsigned long cache_gen = 0;
+	if ((data_block == -1) &&
+	    ((argout = read_cache_get(READ_COIL_STATUS,coil_address,no_coils,cache_gen)) != 0))
+	  return argout;
 
-	  omni_mutex_lock sync(this->rmcs_mutex);
+	if (data_block == -1) {
 
     	  query[0] = READ_COIL_STATUS;
     	  query[1] = coil_address >> 8;
@@ -1172,6 +2021,7 @@ Tango::DevVarShortArray *Modbus::read_multiple_coils_status(const Tango::DevVarS
 	      idx++;
 	    }
       	  }
+	  read_cache_put(READ_COIL_STATUS,coil_address,no_coils,argout,cache_gen);
 
 	} else {
           argout  = new Tango::DevVarShortArray();
@@ -1196,8 +2046,7 @@ void Modbus::preset_multiple_registers(const Tango::DevVarShortArray *argin)
 	DEBUG_STREAM << "Modbus::PresetMultipleRegisters()  - " << device_name << endl;
 	/*----- PROTECTED REGION ID(Modbus::preset_multiple_registers) ENABLED START -----*/
 	
-	short register_address, no_registers, no_bytes;
-	unsigned char query[1024], response[1024];
+	short register_address, no_registers;
 
 	if(argin->length()<3) {
 	  Tango::Except::throw_exception(
@@ -1211,21 +2060,34 @@ void Modbus::preset_multiple_registers(const Tango::DevVarShortArray *argin)
 	
 	check_argin(argin,2+no_registers,"Modbus::preset_multiple_registers");
 
-	query[0] = PRESET_MULTIPLE_REGISTERS;
-	query[1] = register_address >> 8;
-	query[2] = register_address & 0xff;
-	query[3] = no_registers >> 8;
-	query[4] = no_registers & 0xff;
-	query[5] = no_registers * 2;
-	no_bytes = 6;
- 	for (int i=0; i<no_registers; i++) {
-	  query[6+(i*2)]   = ((*argin)[2+i]) >> 8;
-	  no_bytes++;
-	  query[6+(i*2)+1] = ((*argin)[2+i]) & 0xff;
-	  no_bytes++;
-        }
+	// Split in frames of 123 registers max
+	vector<ModbusRequest> requests;
+	for (long done = 0;done < no_registers;)
+	{
+	  long nb = ((no_registers - done) > MAX_NB_WRITE_REG) ? MAX_NB_WRITE_REG : (no_registers - done);
+	  short adr = register_address + done;
+	  ModbusRequest req;
+
+	  req.query[0] = PRESET_MULTIPLE_REGISTERS;
+	  req.query[1] = adr >> 8;
+	  req.query[2] = adr & 0xff;
+	  req.query[3] = nb >> 8;
+	  req.query[4] = nb & 0xff;
+	  req.query[5] = nb * 2;
+	  for (long i=0; i<nb; i++) {
+	    req.query[6+(i*2)]   = ((*argin)[2+done+i]) >> 8;
+	    req.query[6+(i*2)+1] = ((*argin)[2+done+i]) & 0xff;
+	  }
+	  req.query_length = 6 + nb * 2;
+	  req.response_length = 5;
+	  req.done = false;
+	  req.sent = false;
+
+	  requests.push_back(req);
+	  done += nb;
+	}
 
-	SendGet(query,no_bytes,response,5);
+	write_frames(requests,"Modbus::preset_multiple_registers");
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::preset_multiple_registers
 }
@@ -1365,6 +2227,7 @@ void Modbus::preset_single_register_broadcast(const Tango::DevVarShortArray *arg
 	query[4] = value & 0xff;
 
 	modbusCore->Send(query,5);
+	write_invalidate(query);
 	
 	/*----- PROTECTED REGION END -----*/	//	Modbus::preset_single_register_broadcast
 }
@@ -1396,165 +2259,1949 @@ Tango::DevShort Modbus::read_exception_status()
 }
 //--------------------------------------------------------
 /**
- *	Method      : Modbus::add_dynamic_commands()
- *	Description : Create the dynamic commands if any
- *                for specified device.
+ *	Command ReadBlocks related method
+ *	Description: Read several blocks of coils, inputs or registers in one call.
+ *               Blocks found in the cache are served from it, the others are read
+ *               with pipelined requests (see the PipelineDepth property).
+ *
+ *	@param argin argin[3*i] = Function code of block i (1, 2, 3 or 4)
+ *               argin[3*i+1] = Start address of block i
+ *               argin[3*i+2] = Number of data of block i
+ *	@returns argout[0..n-1] = Index in argout of the first data of each block
+ *           argout[n..] = Data of all the blocks (one value per coil or input)
  */
 //--------------------------------------------------------
-void Modbus::add_dynamic_commands()
+Tango::DevVarShortArray *Modbus::read_blocks(const Tango::DevVarShortArray *argin)
 {
-	/*----- PROTECTED REGION ID(Modbus::add_dynamic_commands) ENABLED START -----*/
+	Tango::DevVarShortArray *argout;
+	DEBUG_STREAM << "Modbus::ReadBlocks()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_blocks) ENABLED START -----*/
 	
-	//	Add your own code to create and add dynamic commands if any
+	argout = read_blocks_max_age(argin,-1);
 	
-	/*----- PROTECTED REGION END -----*/	//	Modbus::add_dynamic_commands
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_blocks
+	return argout;
 }
+//--------------------------------------------------------
+/**
+ *	Command ReadScattered related method
+ *	Description: Read a list of scattered coils, inputs or registers.
+ *               The addresses are grouped into the frames which minimise the expected
+ *               read time, according to the latency and byte rate measured on the link.
+ *
+ *	@param argin argin[0] = Function code (1, 2, 3 or 4)
+ *               argin[1..n] = Addresses to read, in any order
+ *	@returns argout[0..n-1] = Values, in the requested order
+ */
+//--------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_scattered(const Tango::DevVarShortArray *argin)
+{
+	Tango::DevVarShortArray *argout;
+	DEBUG_STREAM << "Modbus::ReadScattered()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_scattered) ENABLED START -----*/
+	
+	if (argin->length() < 2)
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"At least 2 input arguments expected.",
+	    (const char *)"Modbus::read_scattered");
+	}
 
-/*----- PROTECTED REGION ID(Modbus::namespace_ending) ENABLED START -----*/
-
-//	Additional Methods
+	short fc = (*argin)[0];
+	if ((fc < READ_COIL_STATUS) || (fc > READ_INPUT_REGISTERS))
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"Invalid function code (function codes 1 to 4 supported).",
+	    (const char *)"Modbus::read_scattered");
+	}
 
-//------------------------------------------------------------
-// Check if argin has the expected length and throw DevFailed 
-// in case of error.
-//------------------------------------------------------------
-void Modbus::check_argin(const Tango::DevVarShortArray *argin,int lgth,const char *where) {
+	// Sorted list of the distinct addresses (modbus addresses are unsigned)
+	long nb_addr = argin->length() - 1;
+	vector<long> addresses(nb_addr);
+	for (long i = 0;i < nb_addr;i++)
+	  addresses[i] = (unsigned short)(*argin)[i + 1];
+	sort(addresses.begin(),addresses.end());
+	addresses.erase(unique(addresses.begin(),addresses.end()),addresses.end());
+
+	// Plan the frames with the measured link cost. The frames are
+	// pipelined on TCP.
+	double latency,sec_per_byte;
+	linkStats.get(latency,sec_per_byte);
+	long depth = (strcasecmp(protocol.c_str(),"TCP") == 0) ? pipelineDepth : 1;
+
+	bool bits = (fc <= READ_INPUT_STATUS);
+	vector<ReadFrame> frames;
+	plan_reads(addresses,bits ? MAX_NB_COIL : MAX_NB_REG,bits ? 0.125 : 2.0,
+	           latency,sec_per_byte,depth,frames);
+
+	DEBUG_STREAM << "Modbus::read_scattered() " << addresses.size() << " addresses in "
+	             << frames.size() << " frames (latency " << latency * 1000.0
+	             << " ms, " << sec_per_byte * 1000000.0 << " us/byte)" << endl;
+
+	// Read the frames (served from the cache or pipelined)
+	Tango::DevVarShortArray blocks_argin;
+	blocks_argin.length(frames.size() * 3);
+	for (size_t f = 0;f < frames.size();f++)
+	{
+	  blocks_argin[f*3] = fc;
+	  blocks_argin[f*3+1] = (short)frames[f].address;
+	  blocks_argin[f*3+2] = (short)frames[f].count;
+	}
+	Tango::DevVarShortArray *blocks = read_blocks(&blocks_argin);
 
-    char tmp[256];
-    sprintf(tmp,"Incorrect number of input arguments (%d expected)",lgth);
-  
-    if (argin->length() != (unsigned int)lgth)
-    {
-	Tango::Except::throw_exception(
-				       (const char *)"Modbus::error_write",
-				       (const char *)tmp,
-				       (const char *)where);		  
-    }
+	// Return the values in the requested order
+	argout = new Tango::DevVarShortArray();
+	argout->length(nb_addr);
+	for (long i = 0;i < nb_addr;i++)
+	{
+	  long adr = (unsigned short)(*argin)[i + 1];
 
+	  // Frames are sorted and disjoint, find the last one starting before adr
+	  long lo = 0,hi = frames.size() - 1;
+	  while (lo < hi)
+	  {
+	    long mid = (lo + hi + 1) / 2;
+	    if (frames[mid].address <= adr)
+	      lo = mid;
+	    else
+	      hi = mid - 1;
+	  }
+	  (*argout)[i] = (*blocks)[(*blocks)[lo] + adr - frames[lo].address];
+	}
+	delete blocks;
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_scattered
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command AsyncWriteStatus related method
+ *	Description: Return the status of the asynchronous write queue (AsyncWrite property).
+ *
+ *	@returns lvalue[0] = Writes pending (queued or being written)
+ *           lvalue[1] = Writes queued since init (id of the last one, from 1)
+ *           lvalue[2] = Id of the last write done (writes are done in order)
+ *           lvalue[3] = Values written
+ *           lvalue[4] = Frames sent
+ *           lvalue[5] = Values which failed to be written
+ *           lvalue[6+2*i] = Id of the failed write i (last 16 failures)
+ *           lvalue[6+2*i+1] = Address of the failed write i
+ *           svalue[0] = Last write error
+ *           svalue[1+i] = Error of the failed write i
+ */
+//--------------------------------------------------------
+Tango::DevVarLongStringArray *Modbus::async_write_status()
+{
+	Tango::DevVarLongStringArray *argout;
+	DEBUG_STREAM << "Modbus::AsyncWriteStatus()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::async_write_status) ENABLED START -----*/
+	
+	WriteQueueStatus st;
+	st.nb_pending = st.nb_queued = st.last_done = 0;
+	st.nb_written = st.nb_frames = st.nb_failed = 0;
+	if (writeThread != 0)
+	  writeThread->get_status(st);
+	else
+	  st.last_error = "Asynchronous write disabled (AsyncWrite property)";
+
+	argout = new Tango::DevVarLongStringArray();
+	argout->lvalue.length(6 + st.failed.size() * 2);
+	argout->lvalue[0] = st.nb_pending;
+	argout->lvalue[1] = st.nb_queued;
+	argout->lvalue[2] = st.last_done;
+	argout->lvalue[3] = st.nb_written;
+	argout->lvalue[4] = st.nb_frames;
+	argout->lvalue[5] = st.nb_failed;
+	argout->svalue.length(1 + st.failed.size());
+	argout->svalue[0] = CORBA::string_dup(st.last_error.c_str());
+	for (size_t i = 0;i < st.failed.size();i++)
+	{
+	  const QueuedWrite &w = st.failed[i].write;
+	  char tmp[64];
+	  sprintf(tmp,"%s %ld = %d: ",(w.coil == true) ? "Coil" : "Register",w.adr,w.value);
+	  argout->lvalue[6 + i*2] = w.id;
+	  argout->lvalue[6 + i*2 + 1] = w.adr;
+	  argout->svalue[1 + i] = CORBA::string_dup((tmp + st.failed[i].error).c_str());
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::async_write_status
+	return argout;
 }
+//--------------------------------------------------------
+/**
+ *	Command ReadFileRecord related method
+ *	Description: Read file records (function code 20).
+ *               Several sub-requests are packed in each frame and the frames
+ *               are pipelined (see the PipelineDepth property).
+ *
+ *	@param argin argin[3*i] = File number of range i
+ *               argin[3*i+1] = Start record number of range i
+ *               argin[3*i+2] = Number of registers of range i
+ *	@returns argout[0..n-1] = Registers of all the ranges
+ */
+//--------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_file_record(const Tango::DevVarShortArray *argin)
+{
+	Tango::DevVarShortArray *argout;
+	DEBUG_STREAM << "Modbus::ReadFileRecord()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_file_record) ENABLED START -----*/
+	
+	//	argin is a list of (file number, record number, number of registers) tuples
+	if ((argin->length() == 0) || ((argin->length() % 3) != 0))
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"Input arguments must be (file number, record number, count) tuples.",
+	    (const char *)"Modbus::read_file_record");
+	}
 
+	long nb_ranges = argin->length() / 3;
+	long total = 0;
+	for (long r = 0;r < nb_ranges;r++)
+	{
+	  if ((*argin)[r*3+2] <= 0)
+	  {
+	    Tango::Except::throw_exception(
+	      (const char *)"Modbus::error_read",
+	      (const char *)"The number of registers to read must be positive.",
+	      (const char *)"Modbus::read_file_record");
+	  }
+	  total += (*argin)[r*3+2];
+	}
+
+	// Pack the ranges in sub-requests (split when needed), as many
+	// sub-requests per frame as the response size allows
+	vector<ModbusRequest> requests;
+	vector<long> sub_frame,sub_index,sub_count;
+	long budget = 0;
+	long index = 0;
+
+	for (long r = 0;r < nb_ranges;r++)
+	{
+	  unsigned short file = (*argin)[r*3];
+	  unsigned short record = (*argin)[r*3+1];
+	  long remaining = (*argin)[r*3+2];
+
+	  while (remaining > 0)
+	  {
+	    ModbusRequest *req = requests.empty() ? NULL : &requests.back();
+	    if ((req == NULL) || (budget < 4) ||
+	        (req->query[1] + 7 > MAX_FILE_RECORD_BYTES))
+	    {
+	      ModbusRequest new_req;
+	      new_req.query[0] = READ_GENERAL_REFERENCE;
+	      new_req.query[1] = 0;
+	      new_req.query_length = 2;
+	      new_req.response_length = 2;
+	      new_req.done = false;
+	      new_req.sent = false;
+	      requests.push_back(new_req);
+	      req = &requests.back();
+	      budget = MAX_FILE_RECORD_BYTES;
+	    }
+
+	    long nb = (budget - 2) / 2;
+	    if (nb > remaining)
+	      nb = remaining;
+
+	    unsigned char *q = req->query + req->query_length;
+	    q[0] = 6;  // Reference type
+	    q[1] = file >> 8;
+	    q[2] = file & 0xff;
+	    q[3] = record >> 8;
+	    q[4] = record & 0xff;
+	    q[5] = nb >> 8;
+	    q[6] = nb & 0xff;
+	    req->query[1] += 7;
+	    req->query_length += 7;
+	    req->response_length += 2 + nb * 2;
+	    budget -= 2 + nb * 2;
+
+	    sub_frame.push_back(requests.size() - 1);
+	    sub_index.push_back(index);
+	    sub_count.push_back(nb);
+
+	    record += nb;
+	    index += nb;
+	    remaining -= nb;
+	  }
+	}
+
+	SendGetPipelined(requests);
+
+	// Unpack the sub-responses
+	argout = new Tango::DevVarShortArray();
+	argout->length(total);
+
+	long pos = 0;
+	for (size_t s = 0;s < sub_frame.size();s++)
+	{
+	  unsigned char *response = requests[sub_frame[s]].response;
+	  if ((s == 0) || (sub_frame[s] != sub_frame[s-1]))
+	    pos = 2;
+
+	  if ((response[pos] != 1 + sub_count[s] * 2) || (response[pos+1] != 6))
+	  {
+	    delete argout;
+	    Tango::Except::throw_exception(
+	      (const char *)"Modbus::error_read",
+	      (const char *)"Unexpected file record sub-response.",
+	      (const char *)"Modbus::read_file_record");
+	  }
+
+	  for (long i = 0;i < sub_count[s];i++)
+	    (*argout)[sub_index[s] + i] = (response[pos + 2 + i*2] << 8) + response[pos + 3 + i*2];
+	  pos += 2 + sub_count[s] * 2;
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_file_record
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command WriteFileRecord related method
+ *	Description: Write file records (function code 21).
+ *               Large tables are split in several frames which are pipelined.
+ *
+ *	@param argin argin[0] = File number
+ *               argin[1] = Start record number
+ *               argin[2] = Number of registers
+ *               argin[3..n+2] = Register values
+ */
+//--------------------------------------------------------
+void Modbus::write_file_record(const Tango::DevVarShortArray *argin)
+{
+	DEBUG_STREAM << "Modbus::WriteFileRecord()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::write_file_record) ENABLED START -----*/
+	
+	if(argin->length()<4) {
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_write",
+	    (const char *)"At least 4 input arguments expected.",
+	    (const char *)"Modbus::write_file_record");
+	}
+
+	unsigned short file = (*argin)[0];
+	unsigned short record = (*argin)[1];
+	short no_registers = (*argin)[2];
+
+	if(no_registers<=0) {
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_write",
+	    (const char *)"The number of registers must be greater than 0.",
+	    (const char *)"Modbus::write_file_record");
+	}
+
+	check_argin(argin,3+no_registers,"Modbus::write_file_record");
+
+	// One sub-request per frame, as large as the request size allows
+	vector<ModbusRequest> requests;
+	for (long done = 0;done < no_registers;)
+	{
+	  long nb = (MAX_FILE_RECORD_BYTES - 7) / 2;
+	  if (nb > no_registers - done)
+	    nb = no_registers - done;
+	  ModbusRequest req;
+
+	  req.query[0] = WRITE_GENERAL_REFERENCE;
+	  req.query[1] = 7 + nb * 2;
+	  req.query[2] = 6;  // Reference type
+	  req.query[3] = file >> 8;
+	  req.query[4] = file & 0xff;
+	  req.query[5] = record >> 8;
+	  req.query[6] = record & 0xff;
+	  req.query[7] = nb >> 8;
+	  req.query[8] = nb & 0xff;
+	  for (long i = 0;i < nb;i++) {
+	    req.query[9+(i*2)]   = ((*argin)[3+done+i]) >> 8;
+	    req.query[9+(i*2)+1] = ((*argin)[3+done+i]) & 0xff;
+	  }
+	  req.query_length = 9 + nb * 2;
+	  // The answer is an echo of the request
+	  req.response_length = req.query_length;
+	  req.done = false;
+	  req.sent = false;
+
+	  requests.push_back(req);
+	  record += nb;
+	  done += nb;
+	}
+
+	write_frames(requests,"Modbus::write_file_record");
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::write_file_record
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadFifoQueue related method
+ *	Description: Read the content of a FIFO queue of registers (function code 24).
+ *               When the FIFO is drained by the cache thread (ReadFifoQueue in the
+ *               CacheConfig property), return the samples kept in the ring, oldest first.
+ *               The samples are not removed, use ReadFifoQueueSince to get the new ones only.
+ *
+ *	@param argin FIFO pointer address
+ *	@returns argout[0..n-1] = FIFO values
+ */
+//--------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_fifo_queue(Tango::DevShort argin)
+{
+	Tango::DevVarShortArray *argout;
+	DEBUG_STREAM << "Modbus::ReadFifoQueue()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_fifo_queue) ENABLED START -----*/
+	
+	int block = get_fifo_block(argin);
+
+	if (block == -1)
+	{
+	  unsigned char query[3], response[MAX_FRAME_SIZE];
+
+	  query[0] = READ_FIFO_QUEUE;
+	  query[1] = argin >> 8;
+	  query[2] = argin & 0xff;
+
+	  short lgth = SendGetCounted(query,3,response,MAX_FIFO_COUNT*2+5);
+
+	  short fifo_count = (lgth < 5) ? 0 : (response[3] << 8) + response[4];
+	  if ((lgth < 5) || (fifo_count > MAX_FIFO_COUNT) || (lgth < 5 + fifo_count*2))
+	  {
+	    Tango::Except::throw_exception(
+	      (const char *)"Modbus::error_read",
+	      (const char *)"Unexpected FIFO count in response.",
+	      (const char *)"Modbus::read_fifo_queue");
+	  }
+
+	  argout = new Tango::DevVarShortArray();
+	  argout->length(fifo_count);
+	  for (int i = 0;i < fifo_count;i++)
+	    (*argout)[i] = (response[i*2+5] << 8) + response[i*2+6];
+	}
+	else
+	{
+	  vector<short> values;
+	  vector<double> dates;
+	  get_fifo_data(block,NULL,values,dates);
+
+	  argout = new Tango::DevVarShortArray();
+	  argout->length(values.size());
+	  for (size_t i = 0;i < values.size();i++)
+	    (*argout)[i] = values[i];
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_fifo_queue
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadFifoQueueTimed related method
+ *	Description: Same as ReadFifoQueue, with the date at which each sample has been
+ *               read from the FIFO.
+ *
+ *	@param argin FIFO pointer address
+ *	@returns argout[2*i] = Date of sample i (seconds since epoch)
+ *           argout[2*i+1] = Value of sample i
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::read_fifo_queue_timed(Tango::DevShort argin)
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::ReadFifoQueueTimed()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_fifo_queue_timed) ENABLED START -----*/
+	
+	vector<short> values;
+	vector<double> dates;
+	int block = get_fifo_block(argin);
+
+	if (block == -1)
+	{
+	  Tango::DevVarShortArray *fifo = read_fifo_queue(argin);
+	  unsigned long s,ns;
+	  omni_thread::get_time(&s,&ns);
+	  double now = (double)s + (double)ns / 1000000000.0;
+	  for (unsigned int i = 0;i < fifo->length();i++)
+	  {
+	    values.push_back((*fifo)[i]);
+	    dates.push_back(now);
+	  }
+	  delete fifo;
+	}
+	else
+	  get_fifo_data(block,NULL,values,dates);
+
+	argout = new Tango::DevVarDoubleArray();
+	argout->length(values.size() * 2);
+	for (size_t i = 0;i < values.size();i++)
+	{
+	  (*argout)[i*2] = dates[i];
+	  (*argout)[i*2+1] = values[i];
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_fifo_queue_timed
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command SchedulerStatistics related method
+ *	Description: Return the statistics of the transaction scheduler.
+ *               All the Modbus exchanges (commands, cache thread, write queue) are
+ *               queued and executed one at a time on the link.
+ *
+ *	@returns [0] = Transactions done since init
+ *           [1] = Transactions queued or running
+ *           [2] = Maximum number of transactions queued
+ *           [3] = Mean time spent in the queue (sec)
+ *           [4] = Maximum time spent in the queue (sec)
+ *           [5] = Mean transaction duration (sec)
+ *           [6] = Maximum transaction duration (sec)
+ *           [7+3*i] = Transactions done in lane i (0: control, 1: interactive, 2: background)
+ *           [8+3*i] = Mean time spent in the queue in lane i (sec)
+ *           [9+3*i] = Maximum time spent in the queue in lane i (sec)
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::scheduler_statistics()
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::SchedulerStatistics()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::scheduler_statistics) ENABLED START -----*/
+	
+	SchedulerStatistics st;
+	memset(&st,0,sizeof(st));
+	if (scheduler != 0)
+	  scheduler->GetStatistics(st);
+
+	argout = new Tango::DevVarDoubleArray();
+	argout->length(7 + 3*NB_LANES);
+	(*argout)[0] = st.nb_transactions;
+	(*argout)[1] = st.queue_depth;
+	(*argout)[2] = st.max_queue_depth;
+	(*argout)[3] = st.mean_wait;
+	(*argout)[4] = st.max_wait;
+	(*argout)[5] = st.mean_service;
+	(*argout)[6] = st.max_service;
+	for (int l = 0;l < NB_LANES;l++)
+	{
+	  (*argout)[7 + 3*l] = st.lanes[l].nb_transactions;
+	  (*argout)[8 + 3*l] = st.lanes[l].mean_wait;
+	  (*argout)[9 + 3*l] = st.lanes[l].max_wait;
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::scheduler_statistics
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command CacheStatistics related method
+ *	Description: Return the timing statistics of the cache thread, one set of
+ *               values per CacheConfig block.
+ *
+ *	@returns [8*i] = Refresh period of block i (ms), the current one with CacheMaxPeriod
+ *           [8*i+1] = Measured mean period (ms)
+ *           [8*i+2] = Period jitter, standard deviation (ms)
+ *           [8*i+3] = Maximum start delay after the deadline (ms)
+ *           [8*i+4] = Deadlines missed (overruns)
+ *           [8*i+5] = Number of refreshes
+ *           [8*i+6] = Age of the cached data (ms), -1 before the first read
+ *           [8*i+7] = Duration of the last read (ms)
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::cache_statistics()
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::CacheStatistics()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::cache_statistics) ENABLED START -----*/
+	
+	argout = new Tango::DevVarDoubleArray();
+	argout->length(8 * cacheDef.size());
+	long long now_us = cache_clock_us();
+
+	for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+	{
+	  CacheTiming tm;
+	  long long date_us;
+	  long latency_us;
+	  {
+	    omni_mutex_lock sync(*(cacheDef[loop].data_block_mutex));
+	    tm = cacheDef[loop].timing;
+	    unsigned long seq;
+	    do {
+	      seq = cache_read_begin(cacheDef[loop]);
+	      date_us = cacheDef[loop].date_us;
+	      latency_us = cacheDef[loop].latency_us;
+	    } while (cache_read_retry(cacheDef[loop],seq));
+	  }
+
+	  double mean = 0.0;
+	  double jitter = 0.0;
+	  if (tm.nb_refresh > 1)
+	  {
+	    double nb = (double)(tm.nb_refresh - 1);
+	    mean = tm.sum_period / nb;
+	    double var = tm.sum_period2 / nb - mean * mean;
+	    jitter = (var > 0.0) ? sqrt(var) : 0.0;
+	  }
+
+	  if (tm.cur_period != 0.0)
+	    (*argout)[8*loop] = tm.cur_period * 1000.0;
+	  else
+	    (*argout)[8*loop] = (cacheDef[loop].period != 0) ? cacheDef[loop].period : cacheSleep;
+	  (*argout)[8*loop + 1] = mean * 1000.0;
+	  (*argout)[8*loop + 2] = jitter * 1000.0;
+	  (*argout)[8*loop + 3] = tm.max_late * 1000.0;
+	  (*argout)[8*loop + 4] = tm.overruns;
+	  (*argout)[8*loop + 5] = tm.nb_refresh;
+	  (*argout)[8*loop + 6] = (date_us != 0) ? (now_us - date_us) / 1000.0 : -1.0;
+	  (*argout)[8*loop + 7] = latency_us / 1000.0;
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::cache_statistics
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command CachePlan related method
+ *	Description: Return the blocks polled by the cache thread and, for each range of
+ *               the CacheConfig property, the blocks serving it (see CacheOptimize).
+ *
+ *	@returns lvalue[4*i] = Function code of polled block i (CacheBlock<i>)
+ *           lvalue[4*i+1] = First address of block i
+ *           lvalue[4*i+2] = Number of data of block i
+ *           lvalue[4*i+3] = Refresh period of block i (ms)
+ *           svalue[j] = CacheConfig range j and the blocks serving it
+ */
+//--------------------------------------------------------
+Tango::DevVarLongStringArray *Modbus::cache_plan()
+{
+	Tango::DevVarLongStringArray *argout;
+	DEBUG_STREAM << "Modbus::CachePlan()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::cache_plan) ENABLED START -----*/
+	
+	argout = new Tango::DevVarLongStringArray();
+	argout->lvalue.length(4 * cacheDef.size());
+	for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+	{
+	  argout->lvalue[4*loop]     = cacheDef[loop].fc;
+	  argout->lvalue[4*loop + 1] = cacheDef[loop].adr;
+	  argout->lvalue[4*loop + 2] = cacheDef[loop].nb;
+	  argout->lvalue[4*loop + 3] = (cacheDef[loop].period != 0) ? cacheDef[loop].period : cacheSleep;
+	}
+
+	argout->svalue.length(cachePlan.size());
+	for (unsigned long loop = 0;loop < cachePlan.size();loop++)
+	  argout->svalue[loop] = CORBA::string_dup(cachePlan[loop].c_str());
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::cache_plan
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadMaxAge related method
+ *	Description: Same as ReadBlocks, but a block is served from the cache only if it was
+ *               read without error less than max age ms ago. Otherwise it is read from
+ *               the device. A max age of 0 always reads the device.
+ *
+ *	@param argin argin[0] = Max age of the cached data (ms)
+ *               argin[3*i+1] = Function code of block i (1, 2, 3 or 4)
+ *               argin[3*i+2] = Start address of block i
+ *               argin[3*i+3] = Number of data of block i
+ *	@returns argout[0..n-1] = Index in argout of the first data of each block
+ *           argout[n..] = Data of all the blocks (one value per coil or input)
+ */
+//--------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_max_age(const Tango::DevVarLongArray *argin)
+{
+	Tango::DevVarShortArray *argout;
+	DEBUG_STREAM << "Modbus::ReadMaxAge()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_max_age) ENABLED START -----*/
+	
+	//	argin[0] is the max age, then the ReadBlocks tuples
+	if ((argin->length() < 4) || (((argin->length() - 1) % 3) != 0) || ((*argin)[0] < 0))
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"Input arguments must be a max age (ms) followed by (function code, address, count) tuples.",
+	    (const char *)"Modbus::read_max_age");
+	}
+
+	Tango::DevVarShortArray blocks;
+	blocks.length(argin->length() - 1);
+	for (unsigned long i = 1;i < argin->length();i++)
+	{
+	  if (((*argin)[i] < SHRT_MIN) || ((*argin)[i] > USHRT_MAX))
+	  {
+	    Tango::Except::throw_exception(
+	      (const char *)"Modbus::error_read",
+	      (const char *)"Function code, address or count out of range.",
+	      (const char *)"Modbus::read_max_age");
+	  }
+	  blocks[i - 1] = (short)(*argin)[i];
+	}
+
+	argout = read_blocks_max_age(&blocks,(long long)(*argin)[0] * 1000);
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_max_age
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadCacheStatistics related method
+ *	Description: Return the statistics of the read-through cache (see ReadCacheSize).
+ *               All zero when the cache is disabled.
+ *
+ *	@returns argout[0] = Number of reads served by the read-through cache (hits)
+ *           argout[1] = Number of misses
+ *           argout[2] = Misses on a range older than ReadCacheTTL
+ *           argout[3] = Ranges dropped because the cache was full
+ *           argout[4] = Ranges dropped by a write
+ *           argout[5] = Number of ranges in the cache
+ *           argout[6] = Hit ratio
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::read_cache_statistics()
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::ReadCacheStatistics()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_cache_statistics) ENABLED START -----*/
+	
+	ReadCacheStatistics st;
+	memset(&st,0,sizeof(st));
+	if (readCache != 0)
+	  readCache->get_statistics(st);
+
+	unsigned long nb_reads = st.nb_hits + st.nb_misses;
+
+	argout = new Tango::DevVarDoubleArray();
+	argout->length(7);
+	(*argout)[0] = st.nb_hits;
+	(*argout)[1] = st.nb_misses;
+	(*argout)[2] = st.nb_expired;
+	(*argout)[3] = st.nb_evicted;
+	(*argout)[4] = st.nb_invalidated;
+	(*argout)[5] = st.nb_entries;
+	(*argout)[6] = (nb_reads != 0) ? (double)st.nb_hits / (double)nb_reads : 0.0;
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_cache_statistics
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadHistory related method
+ *	Description: Return the history of a cached block (see CacheHistoryDepth): the
+ *               samples read after the given date, oldest first. Use 0 to get the
+ *               whole ring.
+ *
+ *	@param argin argin[0] = Cache block index (see CachePlan)
+ *               argin[1] = Date (seconds since epoch), samples read after it are returned
+ *	@returns argout[0] = Number of values per sample (n)
+ *           argout[1 + i*(n+1)] = Date of sample i (seconds since epoch)
+ *           argout[2 + i*(n+1)] ... = Values of sample i
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::read_history(const Tango::DevVarDoubleArray *argin)
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::ReadHistory()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_history) ENABLED START -----*/
+	
+	//	argin[0] is the block index, argin[1] the date
+	if ((argin->length() != 2) || ((*argin)[0] < 0) || ((*argin)[0] >= (double)cacheDef.size()))
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"Input arguments must be a cache block index (see CachePlan) and a date.",
+	    (const char *)"Modbus::read_history");
+	}
+
+	argout = get_history((long)(*argin)[0],(*argin)[1]);
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_history
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Command ReadFifoQueueSince related method
+ *	Description: Return the samples of a FIFO drained by the cache thread since a cursor,
+ *               with their date. The samples are left in the ring:
+ *               several clients can each follow the FIFO with their own cursor.
+ *
+ *	@param argin argin[0] = FIFO pointer address
+ *               argin[1] = Cursor returned by the previous call (0 the first time)
+ *	@returns argout[0] = Cursor to pass to the next call
+ *           argout[1] = Number of samples lost since the cursor (ring too small)
+ *           argout[2+2*i] = Date of sample i (seconds since epoch)
+ *           argout[2+2*i+1] = Value of sample i
+ */
+//--------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::read_fifo_queue_since(const Tango::DevVarDoubleArray *argin)
+{
+	Tango::DevVarDoubleArray *argout;
+	DEBUG_STREAM << "Modbus::ReadFifoQueueSince()  - " << device_name << endl;
+	/*----- PROTECTED REGION ID(Modbus::read_fifo_queue_since) ENABLED START -----*/
+	
+	if (argin->length() != 2)
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"Input arguments must be the FIFO address and the cursor.",
+	    (const char *)"Modbus::read_fifo_queue_since");
+	}
+
+	if (((*argin)[0] < 0.0) || ((*argin)[0] > 65535.0))
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"FIFO address out of range (0..65535).",
+	    (const char *)"Modbus::read_fifo_queue_since");
+	}
+
+	int block = get_fifo_block((unsigned short)(*argin)[0]);
+	if (block == -1)
+	{
+	  Tango::Except::throw_exception(
+	    (const char *)"Modbus::error_read",
+	    (const char *)"The FIFO is not drained by the cache (ReadFifoQueue in CacheConfig).",
+	    (const char *)"Modbus::read_fifo_queue_since");
+	}
+
+	//	Each client keeps its own cursor, the samples are not removed
+	vector<short> values;
+	vector<double> dates;
+	unsigned long cursor = ((*argin)[1] > 0.0) ? (unsigned long)(*argin)[1] : 0;
+	unsigned long lost = get_fifo_data(block,&cursor,values,dates);
+
+	argout = new Tango::DevVarDoubleArray();
+	argout->length(2 + values.size() * 2);
+	(*argout)[0] = (double)cursor;
+	(*argout)[1] = (double)lost;
+	for (size_t i = 0;i < values.size();i++)
+	{
+	  (*argout)[2+i*2] = dates[i];
+	  (*argout)[2+i*2+1] = values[i];
+	}
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::read_fifo_queue_since
+	return argout;
+}
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::add_dynamic_commands()
+ *	Description : Create the dynamic commands if any
+ *                for specified device.
+ */
+//--------------------------------------------------------
+void Modbus::add_dynamic_commands()
+{
+	/*----- PROTECTED REGION ID(Modbus::add_dynamic_commands) ENABLED START -----*/
+	
+	//	Add your own code to create and add dynamic commands if any
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::add_dynamic_commands
+}
+
+/*----- PROTECTED REGION ID(Modbus::namespace_ending) ENABLED START -----*/
+
+//	Additional Methods
+
+//------------------------------------------------------------
+// Check if argin has the expected length and throw DevFailed 
+// in case of error.
+//------------------------------------------------------------
+void Modbus::check_argin(const Tango::DevVarShortArray *argin,int lgth,const char *where) {
+
+    char tmp[256];
+    sprintf(tmp,"Incorrect number of input arguments (%d expected)",lgth);
+  
+    if (argin->length() != (unsigned int)lgth)
+    {
+	Tango::Except::throw_exception(
+				       (const char *)"Modbus::error_write",
+				       (const char *)tmp,
+				       (const char *)where);		  
+    }
+
+}
+
+//---------------------------------------------------------------------------
+// Check if the command result is in the data cache and return data block id
 //---------------------------------------------------------------------------
-// Check if the command result is in the data cache and return data block id
-//---------------------------------------------------------------------------
 
-int Modbus::get_data_block(const char *cmd,short adr,short nb_reg) {
+int Modbus::get_data_block(unsigned char fc,unsigned short adr,long nb_reg,long long max_age_us) {
+
+  if (cacheConfig.empty()) {
+    // No cache
+    return -1;
+  }
+
+  int ret = -1;
+
+  // Indentifie calling thread
+  omni_thread *th = omni_thread::self();
+  if (th != 0) {
+    int th_id = th->id();
+    if (PollingPool::is_worker(th_id))
+      // The cache polling is the caller
+      return -1;
+  } else {
+    return -1;
+  }
+
+  // The range may span several adjacent or overlapping blocks.
+  // Return the first one if all of them are already filled and,
+  // when max_age_us is given, read without error less than
+  // max_age_us ago.
+
+  long long now_us = (max_age_us >= 0) ? cache_clock_us() : 0;
+  long cur = adr;
+  long end = (long)adr + nb_reg;
+  while (cur < end) {
+
+    int block = find_cache_block(fc,cur,1);
+    if (block == -1)
+      return -1;
+
+    // Check that the thread is started
+
+    long long date_us;
+    long latency_us;
+    long long write_us;
+    bool err;
+    bool stale;
+    unsigned long seq;
+    do {
+      seq = cache_read_begin(cacheDef[block]);
+      date_us = cacheDef[block].date_us;
+      latency_us = cacheDef[block].latency_us;
+      write_us = cacheDef[block].write_us;
+      err = cacheDef[block].err;
+      stale = cacheDef[block].stale;
+    } while (cache_read_retry(cacheDef[block],seq));
+
+    if (date_us == 0)
+      return -1;
+
+    // Written since the start of the last read
+    if (date_us - latency_us <= write_us)
+      return -1;
+
+    // The snapshot values have no age, they are never fresh enough
+    // and only served as plain cached values on request
+    if ((stale == true) && ((max_age_us >= 0) || (cacheSnapshotServeStale == false)))
+      return -1;
+    if ((max_age_us >= 0) && ((err == true) || (now_us - date_us > max_age_us)))
+      return -1;
+
+    if (ret == -1)
+      ret = block;
+    cur = cacheDef[block].adr + cacheDef[block].nb;
+  }
+
+  return ret;
+
+}
+
+//------------------------------------------------------------
+// Unpack bits (first bit in the LSB of the first byte) to one
+// short per bit. Whole bytes are expanded through a 256 entries
+// table, 8 values in one copy.
+//------------------------------------------------------------
+struct UnpackTable {
+  short v[256][8];
+  UnpackTable() {
+    for (int b = 0;b < 256;b++)
+      for (int i = 0;i < 8;i++)
+        v[b][i] = (b >> i) & 1;
+  }
+};
+
+static const UnpackTable unpackTable;
+
+static void unpack_bits(const unsigned char *bits,long first,long nb,short *out) {
+
+  const unsigned char *p = bits + first / 8;
+  long bit = first % 8;
+
+  // Head, up to the next byte boundary
+  if (bit != 0) {
+    for (;(bit < 8) && (nb > 0);bit++,nb--)
+      *out++ = unpackTable.v[*p][bit];
+    p++;
+  }
+
+  // Whole bytes
+  for (;nb >= 8;nb -= 8,out += 8)
+    ::memcpy(out,unpackTable.v[*p++],8 * sizeof(short));
+
+  // Tail
+  for (long i = 0;i < nb;i++)
+    out[i] = unpackTable.v[*p][i];
+
+}
+
+//------------------------------------------------------------
+// Retrieve cahched data. data_block is the block returned by
+// get_data_block(), the next ones are found in the cache index
+// when the range spans several blocks. Each block is checked
+// and copied on its own.
+//------------------------------------------------------------
+void Modbus::get_cache_data(int data_block,unsigned short input_address,long no_inputs,Tango::DevVarShortArray *argout) {
+
+  Tango::DevErrorList errs;
+  bool throw_ex = false;
+  long long now_us = cache_clock_us();
+
+  argout->length(no_inputs);
+  long done = 0;
+
+  while ((done < no_inputs) && (throw_ex == false)) {
+
+    if (done != 0) {
+      data_block = find_cache_block(cacheDef[data_block].fc,input_address + done,1);
+      if (data_block == -1) {
+        // The blocks were checked by get_data_block()
+        throw_ex = true;
+        break;
+      }
+    }
+
+    // Lock free copy, retried if the cache thread updated the block
+    // meanwhile
+    CacheDataBlock &cdb = cacheDef[data_block];
+    long start = input_address + done - cdb.adr;
+    long nb = cdb.nb - start;
+    if (nb > no_inputs - done)
+      nb = no_inputs - done;
+    long long date_us;
+    bool err;
+    unsigned long seq;
+
+    do {
+      seq = cache_read_begin(cdb);
+      date_us = cdb.date_us;
+      err = cdb.err;
+      if (err == false) {
+        if (cache_bits(cdb) == true)
+          unpack_bits((unsigned char *)cdb.short_data_cache_ptr,start,nb,argout->get_buffer() + done);
+        else
+          ::memcpy(argout->get_buffer() + done,cdb.short_data_cache_ptr + start,(size_t)nb * sizeof(short));
+      }
+    } while (cache_read_retry(cdb,seq));
+
+    // Check that the thread is still running
+    if (now_us - date_us > cdb.max_age_us) {
+      throw_ex = true;
+    } else if (err == true) {
+      // Get error code
+      omni_mutex_lock sync(*(cdb.data_block_mutex));
+      errs = cdb.errors;
+      throw_ex = true;
+    }
+
+    done += nb;
+  }
+
+   if (throw_ex == true) {
+     // free allocated argout
+     delete argout;
+     if (errs.length() == 0) {
+	Tango::Except::throw_exception(
+          (const char *)"Modbus_ThNotRunning",
+          (const char *)"The thread acquiring data is not running any more",
+          (const char *)"Modbus::get_chache_data");
+     } else
+       throw Tango::DevFailed(errs);
+   }
+
+}
+
+//------------------------------------------------------------
+// Read the data of a cached block with the command defined
+// in the CacheConfig property. Served from the cache unless
+// the caller is the cache thread itself.
+//------------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_cache_block(long block) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+  Tango::DevVarShortArray args;
+  args.length(2);
+  args[0] = cdb.adr;
+  args[1] = cdb.nb;
+
+  switch (cdb.fc) {
+    case READ_HOLDING_REGISTERS:
+      return read_holding_registers(&args);
+    case READ_COIL_STATUS:
+    case READ_INPUT_STATUS: {
+      long nb = cdb.nb;
+      Tango::DevVarShortArray *argout = new Tango::DevVarShortArray();
+      int data_block = get_data_block(cdb.fc,cdb.adr,nb);
+      if (data_block != -1) {
+        get_cache_data(data_block,cdb.adr,nb,argout);
+      } else {
+        vector<unsigned char> bits((nb + 7) / 8);
+        try {
+          read_bits(cdb.fc,cdb.adr,nb,&bits[0]);
+        } catch (Tango::DevFailed &e) {
+          delete argout;
+          throw;
+        }
+        argout->length(nb);
+        unpack_bits(&bits[0],0,nb,argout->get_buffer());
+      }
+      return argout;
+    }
+    case READ_FIFO_QUEUE:
+      return get_fifo_ring(block);
+    default:
+      return read_input_registers(&args);
+  }
+
+}
+
+//------------------------------------------------------------
+// ReadBlocks and ReadMaxAge. With max_age_us >= 0, a block is
+// served from the cache only if it was read less than max_age_us
+// ago without error, otherwise it is read from the device. The
+// cache itself is only refreshed by the cache thread.
+//------------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_blocks_max_age(const Tango::DevVarShortArray *argin,long long max_age_us) {
+
+  Tango::DevVarShortArray *argout;
+
+  // argin is a list of (function code, address, count) tuples
+  if ((argin->length() == 0) || ((argin->length() % 3) != 0)) {
+    Tango::Except::throw_exception(
+      (const char *)"Modbus::error_read",
+      (const char *)"Input arguments must be (function code, address, count) tuples.",
+      (const char *)"Modbus::read_blocks");
+  }
+
+  long nb_blocks = argin->length() / 3;
+  vector<long> offsets(nb_blocks);
+  long total = nb_blocks;
+
+  for (long b = 0;b < nb_blocks;b++) {
+    short fc = (*argin)[b*3];
+    short count = (*argin)[b*3+2];
+    if ((fc < READ_COIL_STATUS) || (fc > READ_INPUT_REGISTERS) || (count <= 0)) {
+      char tmp[256];
+      sprintf(tmp,"Invalid function code or count for block %ld (function codes 1 to 4 supported).",b);
+      Tango::Except::throw_exception(
+        (const char *)"Modbus::error_read",
+        (const char *)tmp,
+        (const char *)"Modbus::read_blocks");
+    }
+    offsets[b] = total;
+    total += count;
+  }
+
+  if (total > SHRT_MAX) {
+    Tango::Except::throw_exception(
+      (const char *)"Modbus::error_read",
+      (const char *)"Too many data requested in one call.",
+      (const char *)"Modbus::read_blocks");
+  }
+
+  argout = new Tango::DevVarShortArray();
+  argout->length(total);
+  for (long b = 0;b < nb_blocks;b++)
+    (*argout)[b] = offsets[b];
+
+  // Serve the blocks found in the cache and build the requests
+  // for the others (120 registers or 2000 coils max per frame)
+  vector<ModbusRequest> requests;
+  vector<long> frame_index, frame_count;
+
+  for (long b = 0;b < nb_blocks;b++) {
+    short fc = (*argin)[b*3];
+    short address = (*argin)[b*3+1];
+    short count = (*argin)[b*3+2];
+
+    int data_block = -1;
+    if ((fc == READ_HOLDING_REGISTERS) || (fc == READ_INPUT_REGISTERS) ||
+        (fc == READ_COIL_STATUS) || (fc == READ_INPUT_STATUS))
+      data_block = get_data_block((unsigned char)fc,address,count,max_age_us);
+
+    if (data_block != -1) {
+      // get_cache_data() frees its argout on error
+      Tango::DevVarShortArray *cached = new Tango::DevVarShortArray();
+      try {
+        get_cache_data(data_block,address,count,cached);
+      } catch (Tango::DevFailed &e) {
+        delete argout;
+        throw e;
+      }
+      for (int i = 0;i < count;i++)
+        (*argout)[offsets[b] + i] = (*cached)[i];
+      delete cached;
+      continue;
+    }
+
+    long max_per_frame = (fc <= READ_INPUT_STATUS) ? MAX_NB_COIL : MAX_NB_REG;
+    for (long done = 0;done < count;) {
+      long nb = ((count - done) > max_per_frame) ? max_per_frame : (count - done);
+      short adr = address + done;
+      ModbusRequest req;
+
+      req.query[0] = fc;
+      req.query[1] = adr >> 8;
+      req.query[2] = adr & 0xff;
+      req.query[3] = nb >> 8;
+      req.query[4] = nb & 0xff;
+      req.query_length = 5;
+      if (fc <= READ_INPUT_STATUS)
+        req.response_length = (nb + 7) / 8 + 2;
+      else
+        req.response_length = nb * 2 + 2;
+      req.done = false;
+      req.sent = false;
+
+      requests.push_back(req);
+      frame_index.push_back(offsets[b] + done);
+      frame_count.push_back(nb);
+      done += nb;
+    }
+  }
+
+  if (requests.empty() == false) {
+    try {
+      SendGetPipelined(requests);
+    } catch (Tango::DevFailed &e) {
+      delete argout;
+      throw e;
+    }
+  }
+
+  // Copy received data to argout
+  for (size_t r = 0;r < requests.size();r++) {
+    unsigned char *response = requests[r].response;
+    long index = frame_index[r];
+
+    if (requests[r].query[0] <= READ_INPUT_STATUS) {
+      for (long i = 0;i < frame_count[r];i++)
+        (*argout)[index + i] = (response[i/8 + 2] >> (i%8)) & 1;
+    } else {
+      for (long i = 0;i < frame_count[r];i++)
+        (*argout)[index + i] = (response[i*2+2] << 8) + response[i*2+3];
+    }
+  }
+
+  return argout;
+
+}
+
+//------------------------------------------------------------
+// Read-through cache lookup. Return NULL when the cache is
+// disabled, on a miss and for the cache thread.
+//------------------------------------------------------------
+Tango::DevVarShortArray *Modbus::read_cache_get(unsigned char fc,unsigned short adr,long nb,unsigned long &gen) {
+
+  gen = 0;
+  if ((readCache == 0) || (omni_thread::self() == 0) ||
+      PollingPool::is_worker(omni_thread::self()->id()))
+    return 0;
+
+  vector<short> data;
+  if (readCache->get(fc,adr,nb,data,gen) == false)
+    return 0;
+
+  Tango::DevVarShortArray *argout = new Tango::DevVarShortArray();
+  argout->length(nb);
+  for (int i = 0;i < nb;i++)
+    (*argout)[i] = data[i];
+  return argout;
+
+}
+
+//------------------------------------------------------------
+// Store a range read by a client in the read-through cache.
+// gen is the generation returned by read_cache_get() before
+// the read: the range is dropped if written meanwhile.
+//------------------------------------------------------------
+void Modbus::read_cache_put(unsigned char fc,unsigned short adr,long nb,const Tango::DevVarShortArray *data,unsigned long gen) {
+
+  if ((readCache == 0) || (omni_thread::self() == 0) ||
+      PollingPool::is_worker(omni_thread::self()->id()))
+    return;
+
+  readCache->put(fc,adr,nb,data->get_buffer(),gen);
+
+}
+
+//------------------------------------------------------------
+// Drop the cached copies of the range written by a query: the
+// read-through cache ranges and the polled blocks overlapping
+// it. Other queries are ignored.
+//------------------------------------------------------------
+void Modbus::write_invalidate(const unsigned char *query) {
+
+  // Written range, the write address of FC23 comes after the
+  // read one
+  int o = (query[0] == READ_WRITE_REGISTERS) ? 5 : 1;
+  unsigned char fc;
+  long adr;
+  long nb;
+
+  switch (query[0]) {
+    case FORCE_SINGLE_COIL:
+      fc = READ_COIL_STATUS;
+      adr = (query[o] << 8) + query[o+1];
+      nb = 1;
+      break;
+    case FORCE_MULTIPLE_COILS:
+      fc = READ_COIL_STATUS;
+      adr = (query[o] << 8) + query[o+1];
+      nb = (query[o+2] << 8) + query[o+3];
+      break;
+    case PRESET_SINGLE_REGISTER:
+    case MASK_WRITE_REGISTER:
+      fc = READ_HOLDING_REGISTERS;
+      adr = (query[o] << 8) + query[o+1];
+      nb = 1;
+      break;
+    case PRESET_MULTIPLE_REGISTERS:
+    case READ_WRITE_REGISTERS:
+      fc = READ_HOLDING_REGISTERS;
+      adr = (query[o] << 8) + query[o+1];
+      nb = (query[o+2] << 8) + query[o+3];
+      break;
+    default:
+      return;
+  }
+
+  if (readCache != 0)
+    readCache->invalidate(fc,adr,nb);
+  cache_block_invalidate(fc,adr,nb);
+
+}
+
+//------------------------------------------------------------
+// Mark the polled blocks overlapping a written range. They are
+// not served until the end of a read started after the write
+// (see get_data_block). With CacheRefreshOnWrite, their poller
+// reads them right away. The block data is left to the cache
+// thread, which is its only writer.
+//------------------------------------------------------------
+void Modbus::cache_block_invalidate(unsigned char fc,long adr,long nb) {
+
+  long long now_us = cache_clock_us();
+
+  for (unsigned long loop = 0;loop < cacheDef.size();loop++) {
+
+    CacheDataBlock &cdb = cacheDef[loop];
+    if ((cdb.fc != fc) || (adr + nb <= cdb.adr) ||
+        (adr >= cdb.adr + cdb.nb))
+      continue;
+
+    {
+      omni_mutex_lock sync(*(cdb.data_block_mutex));
+      cache_write_begin(cdb);
+      cdb.write_us = now_us;
+      cache_write_end(cdb);
+    }
+
+    // Block i is polled by the poller i % N (see init_device).
+    // The pollers are being removed when the device stops.
+    size_t nb_pollers = cachePollers.size();
+    if ((cacheRefreshOnWrite == true) && (cacheStopping == false) && (nb_pollers != 0))
+      PollingPool::instance()->refresh(cachePollers[loop % nb_pollers],loop);
 
-  if (cacheConfig.empty()) {
-    // No cache
-    return -1;
   }
 
-  unsigned long nb_block = cacheDef.size();
-  int ret = -1;
+}
+
+//------------------------------------------------------------
+// Read coils (FC1) or discrete inputs (FC2) as packed bits, in
+// frames of 2000 bits max. Used by the cache thread.
+//------------------------------------------------------------
+void Modbus::read_bits(unsigned char fc,long adr,long nb,unsigned char *bits) {
+
+  unsigned char query[5], response[MAX_FRAME_SIZE];
+
+  for (long done = 0;done < nb;) {
+    long count = ((nb - done) > MAX_NB_COIL) ? MAX_NB_COIL : (nb - done);
+    long a = adr + done;
+    long no_bytes = (count + 7) / 8;
+
+    query[0] = fc;
+    query[1] = a >> 8;
+    query[2] = a & 0xff;
+    query[3] = count >> 8;
+    query[4] = count & 0xff;
+
+    SendGet(query,5,response,no_bytes + 2);
+
+    // MAX_NB_COIL is a multiple of 8: frames start on a byte
+    ::memcpy(bits + done / 8,response + 2,no_bytes);
+    done += count;
+  }
+
+}
+
+//------------------------------------------------------------
+// Find the cache block draining a FIFO. Return -1 if the FIFO
+// is not cached or if the caller is the cache thread.
+//------------------------------------------------------------
+int Modbus::get_fifo_block(unsigned short adr) {
+
+  if (cacheConfig.empty())
+    return -1;
 
-  // Indentifie calling thread
   omni_thread *th = omni_thread::self();
-  if (th != 0) {
-    int th_id = th->id();
-    if (th_id == thId)
-      // ChaceThread is the caller
-      return -1;
-  } else {
+  if ((th == 0) || PollingPool::is_worker(th->id()))
     return -1;
+
+  // A FIFO block covers its pointer address only
+  return find_cache_block(READ_FIFO_QUEUE,adr,1);
+
+}
+
+//------------------------------------------------------------
+// Find a block containing [adr, adr + nb[ in the cache index.
+// Among the blocks starting at or before adr, the one going the
+// farthest is the only candidate.
+//------------------------------------------------------------
+int Modbus::find_cache_block(unsigned char fc,long adr,long nb) {
+
+  vector<CacheIndexEntry> &index = cacheIndex[fc];
+  long lo = 0;
+  long hi = index.size();
+
+  // First entry starting after adr
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (index[mid].start <= adr)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
 
-  for (unsigned long loop = 0;loop < nb_block;loop++)  {
+  if ((lo > 0) && (adr + nb <= index[lo - 1].max_end))
+    return index[lo - 1].max_block;
+  return -1;
+
+}
+
+//------------------------------------------------------------
+// Plan the blocks to poll for the configured ranges. The
+// ranges read with the same command and the same period are
+// planned together with the link cost model, which merges
+// ranges across small gaps and splits at the frame size
+// limit. FIFO blocks are kept as they are.
+//------------------------------------------------------------
+void Modbus::optimize_cache_config(const vector<CacheDataBlock> &ranges,vector<CacheDataBlock> &blocks) {
 
-    if (cacheDef[loop].cmd_name != cmd)
+  vector<bool> planned(ranges.size(),false);
+
+  double latency,sec_per_byte;
+  linkStats.get(latency,sec_per_byte);
+
+  for (size_t i = 0;i < ranges.size();i++) {
+
+    if (planned[i] == true)
       continue;
-    else {
-      if ((adr >= cacheDef[loop].in_args[0]) &&
-	  (adr < (cacheDef[loop].in_args[0] + cacheDef[loop].in_args[1]))) {
-        if ((adr + nb_reg) <= (cacheDef[loop].in_args[0] + cacheDef[loop].in_args[1])) {
-          ret = loop;
-          break;
-        }
-      } else
-	continue;
+
+    const CacheDataBlock &r = ranges[i];
+    if (r.fc == READ_FIFO_QUEUE) {
+      blocks.push_back(r);
+      planned[i] = true;
+      continue;
+    }
+
+    vector<long> addresses;
+    for (size_t j = i;j < ranges.size();j++) {
+      if ((ranges[j].fc != r.fc) || (ranges[j].period != r.period) ||
+          (ranges[j].phase != r.phase))
+        continue;
+      for (long a = 0;a < ranges[j].nb;a++)
+        addresses.push_back(ranges[j].adr + a);
+      planned[j] = true;
     }
+    sort(addresses.begin(),addresses.end());
+    addresses.erase(unique(addresses.begin(),addresses.end()),addresses.end());
+
+    bool bits = cache_bits(r);
+    vector<ReadFrame> frames;
+    // The cache blocks are polled one by one, never pipelined
+    plan_reads(addresses,bits ? MAX_NB_COIL : MAX_NB_REG,bits ? 0.125 : 2.0,
+               latency,sec_per_byte,1,frames);
+
+    for (size_t f = 0;f < frames.size();f++) {
+      CacheDataBlock b = r;
+      b.adr = frames[f].address;
+      b.nb = frames[f].count;
+      blocks.push_back(b);
+    }
+  }
+
+}
 
+//------------------------------------------------------------
+// Init the device from its own thread (see replan_cache)
+//------------------------------------------------------------
+class CacheReplanThread: public omni_thread {
+public:
+  CacheReplanThread(const string &name):device(name) {}
+  void run(void *) {
+    try {
+      Tango::DeviceProxy dev(device);
+      dev.command_inout("Init");
+    } catch (Tango::DevFailed &e) {
+      Tango::Except::print_exception(e);
+    }
   }
+private:
+  string device;
+};
 
-  // Check that the thread is started
+//------------------------------------------------------------
+// Once the link is measured, plan the cache blocks again. If
+// the plan changed, the device is initialised again (the block
+// buffers, pollers and CacheBlock attributes depend on it),
+// through the Init command from another thread: the caller may
+// be a poller, stopped by the Init.
+//------------------------------------------------------------
+void Modbus::replan_cache() {
 
-  if (ret != -1)
   {
-    unsigned int th_sec;
+    omni_mutex_lock sync(cachePlanMutex);
+    if (cachePlanSeeded == false)
+      return;
+    cachePlanSeeded = false;
+  }
+
+  vector<CacheDataBlock> blocks;
+  optimize_cache_config(cacheRanges,blocks);
+
+  bool same = (blocks.size() == cacheDef.size());
+  for (size_t i = 0;(same == true) && (i < blocks.size());i++)
+    same = (blocks[i].fc == cacheDef[i].fc) && (blocks[i].adr == cacheDef[i].adr) &&
+           (blocks[i].nb == cacheDef[i].nb);
+  if (same == true)
+    return;
+
+  INFO_STREAM << "Modbus::replan_cache() cache blocks planned again with the measured link" << endl;
+  (new CacheReplanThread(device_name))->start();
+
+}
+
+//------------------------------------------------------------
+// Describe, for each configured range, the polled blocks
+// serving it (see the CachePlan command)
+//------------------------------------------------------------
+void Modbus::build_cache_plan(vector<CacheDataBlock> &ranges) {
+
+  cachePlan.clear();
+
+  for (size_t i = 0;i < ranges.size();i++) {
+
+    CacheDataBlock &r = ranges[i];
+    stringstream ss;
+    ss << cache_cmd_name(r.fc) << " " << r.adr << " " << r.nb << " ->";
+
+    long cur = r.adr;
+    long end = (r.fc == READ_FIFO_QUEUE) ? cur + 1 : cur + r.nb;
+    while (cur < end) {
+      int block = find_cache_block(r.fc,cur,1);
+      if (block == -1)
+        break;
+      ss << " CacheBlock" << block;
+      if (r.fc == READ_FIFO_QUEUE)
+        break;
+      cur = cacheDef[block].adr + cacheDef[block].nb;
+    }
+
+    cachePlan.push_back(ss.str());
+  }
+
+}
+
+//------------------------------------------------------------
+// Build the cache index: for each function code, the blocks
+// sorted on their first address with the running maximum of
+// their end address. get_data_block() then finds a block
+// containing a range with one binary search.
+//------------------------------------------------------------
+void Modbus::build_cache_index() {
+
+  for (int fc = 0;fc <= READ_FIFO_QUEUE;fc++)
+    cacheIndex[fc].clear();
+
+  vector<pair<long,int> > sorted;
+  for (unsigned long loop = 0;loop < cacheDef.size();loop++)
+    sorted.push_back(pair<long,int>(cacheDef[loop].adr,loop));
+  // Equal addresses: the first configured block wins
+  sort(sorted.begin(),sorted.end());
+
+  for (size_t i = 0;i < sorted.size();i++) {
+    int block = sorted[i].second;
+    CacheDataBlock &cdb = cacheDef[block];
+    vector<CacheIndexEntry> &index = cacheIndex[cdb.fc];
+    long end = (cdb.fc == READ_FIFO_QUEUE) ? cdb.adr + 1 : cdb.adr + cdb.nb;
+
+    CacheIndexEntry e;
+    e.start = cdb.adr;
+    e.max_end = end;
+    e.max_block = block;
+    if ((index.empty() == false) && (index.back().max_end >= end)) {
+      e.max_end = index.back().max_end;
+      e.max_block = index.back().max_block;
+    }
+    index.push_back(e);
+  }
+
+}
+
+//------------------------------------------------------------
+// Empty a FIFO into the ring of its cache block. A full answer
+// means that more samples may be queued. The number of reads
+// is bounded to not starve the other cached blocks.
+//------------------------------------------------------------
+void Modbus::drain_fifo(long block,double when) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+  unsigned long ring_size = cdb.nb;
+  long max_read = ring_size / MAX_FIFO_COUNT + 1;
+
+  for (long n = 0;n < max_read;n++) {
+
+    Tango::DevVarShortArray *values = read_fifo_queue(cdb.adr);
+    long nb = values->length();
+
     {
-      omni_mutex_lock sync(*(cacheDef[ret].data_block_mutex));
-      th_sec = cacheDef[ret].nb_sec;
+      omni_mutex_lock sync(*(cdb.data_block_mutex));
+      for (long i = 0;i < nb;i++) {
+        unsigned long idx = cdb.fifo_write % ring_size;
+        cdb.short_data_cache_ptr[idx] = (*values)[i];
+        cdb.fifo_time_ptr[idx] = when;
+        cdb.fifo_write++;
+      }
     }
-	
-    if (th_sec == 0)
-      ret = -1;
+
+    delete values;
+    if (nb < MAX_FIFO_COUNT)
+      break;
+
   }
-	
-  return ret;
 
 }
 
 //------------------------------------------------------------
-// Retrieve cahched data
+// Return the samples drained since a cursor, with their date.
+// The cursor is the number of samples drained before the first
+// one to return, it is moved after the last one returned. The
+// samples already overwritten in the ring are counted as lost.
+// Without cursor, the samples kept in the ring are returned
+// (ReadFifoQueue), a read does not remove them.
 //------------------------------------------------------------
-void Modbus::get_cache_data(int data_block,short input_address,short no_inputs,Tango::DevVarShortArray *argout) {
+unsigned long Modbus::get_fifo_data(int block,unsigned long *cursor,vector<short> &values,vector<double> &dates) {
 
-  long start = input_address - cacheDef[data_block].in_args[0];
-  struct timeval when;
+  CacheDataBlock &cdb = cacheDef[block];
+  unsigned long ring_size = cdb.nb;
   Tango::DevErrorList errs;
   bool throw_ex = false;
-
-#ifdef _TG_WINDOWS_
-  struct _timeb now_win;
-  _ftime(&now_win);
-  when.tv_sec = (unsigned long)now_win.time;
-  when.tv_usec = (long)now_win.millitm * 1000;
-#else
-  gettimeofday(&when,NULL);
-#endif
+  unsigned long lost = 0;
+  long long now_us = cache_clock_us();
 
   {
-    omni_mutex_lock sync(*(cacheDef[data_block].data_block_mutex));
+    omni_mutex_lock sync(*(cdb.data_block_mutex));
+    unsigned long ring_start = 0;
+    unsigned long &from = (cursor != NULL) ? *cursor : ring_start;
 
-    // Check that the thread is still running
-    unsigned int th_sec = cacheDef[data_block].nb_sec;
-    unsigned int delta_sec = when.tv_sec - th_sec;
+    // Thread not started yet: nothing drained
+    if (cdb.date_us == 0)
+      return 0;
 
-    if (delta_sec > (unsigned int)maxDeltaTh) {
+    if (now_us - cdb.date_us > cdb.max_age_us) {
+      throw_ex = true;
+    } else if (cdb.err == true) {
+      // Keep the drained samples for the next read
+      errs = cdb.errors;
       throw_ex = true;
     } else {
+      // A cursor ahead of the ring comes from a previous device
+      // start, all the samples are returned
+      if (from > cdb.fifo_write)
+        from = 0;
+      if (cdb.fifo_write - from > ring_size) {
+        if (cursor != NULL)
+          lost = cdb.fifo_write - ring_size - from;
+        from = cdb.fifo_write - ring_size;
+      }
+      for (unsigned long n = from;n < cdb.fifo_write;n++) {
+        values.push_back(cdb.short_data_cache_ptr[n % ring_size]);
+        dates.push_back(cdb.fifo_time_ptr[n % ring_size]);
+      }
+      from = cdb.fifo_write;
+    }
+  }
 
-      // Get data or error code
-      if (cacheDef[data_block].err == false) {
-        argout->length(no_inputs);
-        for (int i = 0;i < no_inputs;i++)
-          (*argout)[i] = cacheDef[data_block].short_data_cache_ptr[start + i];
-      } else {
-        errs = cacheDef[data_block].errors;
-        throw_ex = true;
+  if (lost != 0)
+    WARN_STREAM << "Modbus::get_fifo_data() " << lost << " FIFO samples lost (CacheConfig ring too small)" << endl;
+
+  if (throw_ex == true) {
+    if (errs.length() == 0) {
+      Tango::Except::throw_exception(
+        (const char *)"Modbus_ThNotRunning",
+        (const char *)"The thread acquiring data is not running any more",
+        (const char *)"Modbus::get_fifo_data");
+    } else
+      throw Tango::DevFailed(errs);
+  }
+
+  return lost;
+
+}
+
+//------------------------------------------------------------
+// Return the ring of a FIFO block, oldest sample first
+//------------------------------------------------------------
+Tango::DevVarShortArray *Modbus::get_fifo_ring(long block) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+  unsigned long ring_size = cdb.nb;
+  Tango::DevVarShortArray *argout = new Tango::DevVarShortArray();
+
+  omni_mutex_lock sync(*(cdb.data_block_mutex));
+  unsigned long first = (cdb.fifo_write > ring_size) ? cdb.fifo_write - ring_size : 0;
+  argout->length(cdb.fifo_write - first);
+  for (unsigned long n = first;n < cdb.fifo_write;n++)
+    (*argout)[n - first] = cdb.short_data_cache_ptr[n % ring_size];
+
+  return argout;
+
+}
+
+//------------------------------------------------------------
+// Check if cached data changed since the last pushed event.
+// Without deadband, any difference is a change and memcmp
+// (vectorized by the C library) does the job. With deadband,
+// the registers are checked by chunks with a loop without
+// branch nor division, which the compiler vectorizes. The
+// values are exact in float. A disabled threshold is infinite
+// (its test is then always false, also for inf * 0).
+//------------------------------------------------------------
+#define DEADBAND_CHUNK 64
+
+static bool cache_data_changed(const short *prev,const short *cur,long nb_data,
+                               double abs_change,double rel_change) {
+
+  if (::memcmp(prev,cur,(size_t)nb_data * sizeof(short)) == 0)
+    return false;
+
+  if ((abs_change <= 0.0) && (rel_change <= 0.0))
+    return true;
+
+  const float abs_min = (abs_change > 0.0) ? (float)abs_change : HUGE_VALF;
+  const float rel_min = (rel_change > 0.0) ? (float)rel_change : HUGE_VALF;
+
+  for (long first = 0;first < nb_data;first += DEADBAND_CHUNK) {
+    long last = (first + DEADBAND_CHUNK < nb_data) ? first + DEADBAND_CHUNK : nb_data;
+    int changed = 0;
+    for (long i = first;i < last;i++) {
+      float p = (float)prev[i];
+      float delta = fabsf((float)cur[i] - p);
+      changed |= (delta >= abs_min) |
+                 ((delta > 0.0f) & (delta * 100.0f >= rel_min * fabsf(p)));
+    }
+    if (changed != 0)
+      return true;
+  }
+
+  return false;
+
+}
+
+//------------------------------------------------------------
+// Add the block just read to its history ring. Called by the
+// cache thread, which is the only writer of the block data.
+//------------------------------------------------------------
+void Modbus::record_history(long block,double when) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+  if (cdb.history_ptr == NULL)
+    return;
+
+  long nb_words = cache_words(cdb);
+  unsigned long idx = cdb.history_write % cacheHistoryDepth;
+
+  omni_mutex_lock sync(*(cdb.data_block_mutex));
+  ::memcpy(cdb.history_ptr + idx * nb_words,cdb.short_data_cache_ptr,(size_t)nb_words * sizeof(short));
+  cdb.history_time_ptr[idx] = when;
+  cdb.history_write++;
+
+}
+
+//------------------------------------------------------------
+// Return the history samples of a block read after since,
+// oldest first: the number of values per sample, then the
+// date and the values of each sample
+//------------------------------------------------------------
+Tango::DevVarDoubleArray *Modbus::get_history(long block,double since) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+  if (cdb.history_ptr == NULL) {
+    Tango::Except::throw_exception(
+      (const char *)"Modbus::error_read",
+      (const char *)"No history for this block (CacheHistoryDepth is 0 or the block is a FIFO).",
+      (const char *)"Modbus::get_history");
+  }
+
+  long nb_data = cdb.nb;
+  long nb_words = cache_words(cdb);
+  vector<short> values;
+  vector<double> dates;
+
+  {
+    omni_mutex_lock sync(*(cdb.data_block_mutex));
+    unsigned long first = 0;
+    if (cdb.history_write > (unsigned long)cacheHistoryDepth)
+      first = cdb.history_write - cacheHistoryDepth;
+    for (unsigned long n = first;n < cdb.history_write;n++) {
+      unsigned long idx = n % cacheHistoryDepth;
+      if (cdb.history_time_ptr[idx] <= since)
+        continue;
+      short *sample = cdb.history_ptr + idx * nb_words;
+      values.insert(values.end(),sample,sample + nb_words);
+      dates.push_back(cdb.history_time_ptr[idx]);
+    }
+  }
+
+  Tango::DevVarDoubleArray *argout = new Tango::DevVarDoubleArray();
+  argout->length(1 + dates.size() * (nb_data + 1));
+  (*argout)[0] = nb_data;
+
+  vector<short> unpacked(nb_data);
+  for (size_t i = 0;i < dates.size();i++) {
+    short *sample = &values[i * nb_words];
+    if (cache_bits(cdb) == true) {
+      unpack_bits((unsigned char *)sample,0,nb_data,&unpacked[0]);
+      sample = &unpacked[0];
+    }
+    double *out = argout->get_buffer() + 1 + i * (nb_data + 1);
+    out[0] = dates[i];
+    for (long j = 0;j < nb_data;j++)
+      out[j + 1] = sample[j];
+  }
+
+  return argout;
+
+}
+
+//------------------------------------------------------------
+// Save a block just read in the cache snapshot
+//------------------------------------------------------------
+void Modbus::snapshot_cache_block(long block) {
+
+  if (cacheSnapshot != NULL)
+    cacheSnapshot->store(block);
+
+}
+
+//------------------------------------------------------------
+// Report an unexpected error of a cache poll. Called by the
+// polling pool worker, which goes on polling.
+//------------------------------------------------------------
+void Modbus::cache_poll_failed(const char *reason) {
+
+  ERROR_STREAM << "Modbus::cache_poll_failed() " << device_name << " : " << reason << endl;
+
+}
+
+//------------------------------------------------------------
+// Push change and archive events on the CacheBlock attribute
+// if the block data changed. Called by the cache thread after
+// each block update. Errors are pushed once when they occur.
+//------------------------------------------------------------
+void Modbus::push_cache_event(long block) {
+
+  CacheDataBlock &cdb = cacheDef[block];
+
+  if ((cacheEvents == false) || (cdb.event_data_ptr == NULL) ||
+      ((unsigned long)block >= cacheAttNames.size()))
+    return;
+
+  // The cache thread is the only writer of the block, no need
+  // to take the data block mutex here
+  try {
+
+    if (cdb.err == true) {
+      if (cdb.event_err == false) {
+        Tango::DevFailed df(cdb.errors);
+        push_change_event(cacheAttNames[block],&df);
+        push_archive_event(cacheAttNames[block],&df);
+        cdb.event_err = true;
+        cdb.event_valid = false;
       }
+      return;
+    }
 
+    long nb_data = cdb.nb;
+    short *data = cdb.short_data_cache_ptr;
+    vector<short> unpacked;
+    if (cache_bits(cdb) == true) {
+      unpacked.resize(nb_data);
+      unpack_bits((unsigned char *)cdb.short_data_cache_ptr,0,nb_data,&unpacked[0]);
+      data = &unpacked[0];
     }
 
+    if ((cdb.event_valid == true) &&
+        (cache_data_changed(cdb.event_data_ptr,data,nb_data,
+                            cacheEventAbsChange,cacheEventRelChange) == false))
+      return;
+
+    ::memcpy(cdb.event_data_ptr,data,(size_t)nb_data * sizeof(short));
+    cdb.event_valid = true;
+    cdb.event_err = false;
+    push_change_event(cacheAttNames[block],cdb.event_data_ptr,nb_data);
+    push_archive_event(cacheAttNames[block],cdb.event_data_ptr,nb_data);
+
+  } catch (Tango::DevFailed &e) {
+    // Event system not available, clients will poll
+    WARN_STREAM << "Modbus::push_cache_event() failed for " << cacheAttNames[block]
+                << " : " << e.errors[0].desc << endl;
   }
 
-   if (throw_ex == true) {
-     // free allocated argout
-     delete argout;
-     if (errs.length() == 0) {
-	Tango::Except::throw_exception(
-          (const char *)"Modbus_ThNotRunning",
-          (const char *)"The thread acquiring data is not running any more",
-          (const char *)"Modbus::get_chache_data");
-     } else
-       throw Tango::DevFailed(errs);
-   }
+}
+
+//------------------------------------------------------------
+// Connection of the cache poller run by the calling thread
+// (PollingConnections). NULL for the other threads, which go
+// through the scheduler. A poller is run by one worker at a
+// time, its connection does not need the scheduler. Its
+// exchanges are therefore not in SchedulerStatistics and not
+// subject to LaneWeights (they do not compete with the device
+// connection).
+//------------------------------------------------------------
+ModbusCore *Modbus::polling_core() {
+
+  CachePoller *p = PollingPool::current_poller();
+  if (p == NULL)
+    return NULL;
+  if (find(cachePollers.begin(),cachePollers.end(),p) == cachePollers.end())
+    return NULL;
+  return p->get_core();
 
 }
 
 void Modbus::SendGet (unsigned char *query, short query_length, 
 	         unsigned char *response, short response_length){
+    // Measured exchanges feed the link cost model (see ReadScattered).
+    // Only the time on the wire is used, not the time in the queue.
+    double service;
+    ModbusCore *core = polling_core();
+    // Written ranges are dropped from the read-through cache, also
+    // on failure as the device may have done the write.
     try{
-        modbusCore->SendGet(query,query_length,response,response_length);
+        if (core) {
+            double start = LinkStats::now();
+            core->SendGet(query,query_length,response,response_length);
+            service = LinkStats::now() - start;
+        } else
+            scheduler->SendGet(query,query_length,response,response_length,&service);
+        linkStats.add(query_length + response_length,service);
+        if ((cachePlanSeeded == true) && (linkStats.is_fitted() == true))
+            replan_cache();
+        write_invalidate(query);
     }catch(Tango::DevFailed ex){
         
         for(int i = 0 ;  i < numberOfRetry ; i++) {
@@ -1564,15 +4211,149 @@ void Modbus::SendGet (unsigned char *query, short query_length,
         usleep(sleepBetweenRetry * 1000);
 #endif
             try {
-                modbusCore->SendGet(query,query_length,response,response_length);
+                (core ? core : modbusCore)->SendGet(query,query_length,response,response_length);
+                write_invalidate(query);
+                return;
+            }catch(Tango::DevFailed e){
+                ex = e;
+            }
+        }
+        write_invalidate(query);
+        throw ex;
+    }
+}
+
+//------------------------------------------------------------
+// Write a table split in several frames. The frames are sent
+// pipelined except the last one, which is sent once all the
+// others are written: the end of a table (often a trigger or
+// checksum register) is always written last. On failure, the
+// error reports the address ranges written and not written.
+//------------------------------------------------------------
+void Modbus::write_frames(vector<ModbusRequest> &requests,const char *where) {
+
+  if (requests.empty())
+    return;
+
+  bool held = true;
+  try {
+    requests.back().done = true;
+    SendGetPipelined(requests);
+    requests.back().done = false;
+    held = false;
+    SendGetPipelined(requests);
+  } catch (Tango::DevFailed &e) {
+
+    if (held)
+      requests.back().done = false;
+    if (requests.size() == 1)
+      throw e;
+
+    string written,not_written;
+    for (size_t i = 0;i < requests.size();i++) {
+      // Address (record number for file records) and count
+      int o = (requests[i].query[0] == WRITE_GENERAL_REFERENCE) ? 5 : 1;
+      long adr = (unsigned short)((requests[i].query[o] << 8) + requests[i].query[o+1]);
+      long nb = (requests[i].query[o+2] << 8) + requests[i].query[o+3];
+      char range[64];
+      sprintf(range,",%ld-%ld",adr,adr + nb - 1);
+      if (requests[i].done)
+        written += range;
+      else
+        not_written += range;
+    }
+
+    string desc = "Partial write, written: ";
+    desc += written.empty() ? "none" : written.substr(1);
+    desc += ", not written: ";
+    desc += not_written.empty() ? "none" : not_written.substr(1);
+
+    Tango::Except::re_throw_exception(e,
+      (const char *)"Modbus::error_write",
+      (const char *)desc.c_str(),
+      (const char *)where);
+  }
+
+}
+
+//------------------------------------------------------------
+// Send a query with a variable length answer (retried as
+// SendGet). Return the answer length.
+//------------------------------------------------------------
+short Modbus::SendGetCounted (unsigned char *query, short query_length,
+	         unsigned char *response, short max_length){
+    ModbusCore *core = polling_core();
+    if (core == NULL)
+        core = modbusCore;
+    try{
+        return core->SendGetCounted(query,query_length,response,max_length);
+    }catch(Tango::DevFailed ex){
+
+        for(int i = 0 ;  i < numberOfRetry ; i++) {
+#ifdef WIN32
+		Sleep(sleepBetweenRetry);
+#else
+        usleep(sleepBetweenRetry * 1000);
+#endif
+            try {
+                return core->SendGetCounted(query,query_length,response,max_length);
+            }catch(Tango::DevFailed e){
+                ex = e;
+            }
+        }
+        throw ex;
+    }
+}
+
+//------------------------------------------------------------
+// Send several queries (pipelined on TCP). On failure, only
+// the requests which did not get their answer are retried.
+//------------------------------------------------------------
+void Modbus::SendGetPipelined (vector<ModbusRequest> &requests){
+    ModbusCore *core = polling_core();
+    if (core == NULL)
+        core = modbusCore;
+    // Only the requests sent by this call are dropped from the cache
+    // (the held back frame of write_frames is sent by a second call)
+    vector<bool> before(requests.size());
+    for(size_t r = 0 ; r < requests.size() ; r++)
+        before[r] = requests[r].sent;
+    try{
+        core->SendGetPipelined(requests);
+        pipelined_invalidate(requests,before);
+    }catch(Tango::DevFailed ex){
+
+        for(int i = 0 ;  i < numberOfRetry ; i++) {
+#ifdef WIN32
+		Sleep(sleepBetweenRetry);
+#else
+        usleep(sleepBetweenRetry * 1000);
+#endif
+            try {
+                core->SendGetPipelined(requests);
+                pipelined_invalidate(requests,before);
                 return;
             }catch(Tango::DevFailed e){
                 ex = e;
             }
         }
+        pipelined_invalidate(requests,before);
         throw ex;
     }
 }
 
+//------------------------------------------------------------
+// Drop from the cache the ranges of the requests sent since
+// before[] was taken. A request sent without answer is dropped
+// too, the device may have done the write.
+//------------------------------------------------------------
+void Modbus::pipelined_invalidate(const vector<ModbusRequest> &requests,const vector<bool> &before) {
+
+  for (size_t r = 0;r < requests.size();r++)
+    if (requests[r].sent && !before[r])
+      write_invalidate(requests[r].query);
+
+}
+
 /*----- PROTECTED REGION END -----*/	//	Modbus::namespace_ending
 } //	namespace
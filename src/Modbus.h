@@ -41,6 +41,11 @@
 #include <tango.h>
 #include "ModbusCore.h"
 #include "CacheThread.h"
+#include "ReadPlanner.h"
+#include "WriteThread.h"
+#include "ReadCache.h"
+#include "CacheSnapshot.h"
+#include "TransactionScheduler.h"
 
 
 /*----- PROTECTED REGION END -----*/	//	Modbus.h
@@ -66,22 +71,37 @@ class Modbus : public TANGO_BASE_CLASS
 //	Add your own data members
 
 	ModbusCore *modbusCore;
+	TransactionScheduler *scheduler;
 
-	CacheThread				*theThread;
-	ThreadCmd				thCmd;
-	omni_mutex				thCmdMutex;
+	vector<CachePoller *>			cachePollers;
+	volatile bool				cacheStopping;
+	vector<ModbusCore *>			pollerCores;
 	vector<CacheDataBlock>			cacheDef;
-	int					thId;
-	Tango::DevLong				maxDeltaTh;
-	omni_mutex				rhr_mutex;
-	omni_mutex				rir_mutex;
-	omni_mutex				rmcs_mutex;
+	vector<string>				cacheAttNames;
+	LinkStats				linkStats;
+	WriteThread				*writeThread;
+	ReadCache				*readCache;
+	CacheSnapshot				*cacheSnapshot;
+	omni_mutex				*cacheMutexes;
+	short					*cacheArena;
+	double					*cacheDates;
 
 	std::string error_;
 
 	void check_argin(const Tango::DevVarShortArray *argin,int lgth,const char *where);
-	int get_data_block(const char *,short,short);
-	void get_cache_data(int data_block,short input_address,short no_inputs,Tango::DevVarShortArray *argout);
+	vector<CacheIndexEntry>			cacheIndex[READ_FIFO_QUEUE + 1];
+	vector<string>				cachePlan;
+	vector<CacheDataBlock>			cacheRanges;
+	volatile bool				cachePlanSeeded;
+	omni_mutex				cachePlanMutex;
+	void optimize_cache_config(const vector<CacheDataBlock> &,vector<CacheDataBlock> &);
+	void replan_cache();
+	void build_cache_plan(vector<CacheDataBlock> &);
+	void build_cache_index();
+	int find_cache_block(unsigned char,long,long);
+	ModbusCore *polling_core();
+	int get_data_block(unsigned char,unsigned short,long,long long max_age_us = -1);
+	void get_cache_data(int data_block,unsigned short input_address,long no_inputs,Tango::DevVarShortArray *argout);
 
 /*----- PROTECTED REGION END -----*/	//	Modbus::Data Members
 
@@ -102,6 +122,12 @@ public:
 	//  ReadInutRegisters or ReadMultipleCoilStatus)
 	//  2 - First address to be read
 	//  3 - Number of data to read
+	//  With ReadFifoQueue, 2 is the FIFO pointer address and 3 the size
+	//  of the ring keeping the samples drained from the FIFO.
+	//  An optional 4th parameter period[:phase] (in ms) gives the block its own
+	//  refresh period, the first refresh being delayed by phase. Blocks without
+	//  period are refreshed every CacheSleep ms.
+	//  ReadMultipleCoilStatus and ReadInputStatus blocks are kept as packed bits.
 	vector<string>	cacheConfig;
 	//	CacheSleep:	Cache update thread main loop sleeping time (in ms)CacheSleep
 	Tango::DevLong	cacheSleep;
@@ -124,6 +150,107 @@ public:
 	Tango::DevBoolean	tCPKeepAlive;
 	//	Port:	The port of the host modbus connection for the TCP protocol. Defaults to 502
 	Tango::DevShort	port;
+	//	CacheEvents:	Set this property to true to push change and archive events for
+	//  the cached data. One spectrum attribute (CacheBlock<n>) is created
+	//  per CacheConfig block and an event is pushed each time the cache
+	//  thread detects a change in the block data.
+	Tango::DevBoolean	cacheEvents;
+	//	CacheEventAbsChange:	Absolute change (deadband) required on at least one register of a
+	//  cached block before an event is pushed. 0 means any change.
+	Tango::DevDouble	cacheEventAbsChange;
+	//	CacheEventRelChange:	Relative change (in %) required on at least one register of a
+	//  cached block before an event is pushed. 0 means any change.
+	Tango::DevDouble	cacheEventRelChange;
+	//	PipelineDepth:	Maximum number of requests in flight on the TCP connection for
+	//  the multi-request commands (ReadBlocks). Each request gets its own
+	//  MBAP transaction identifier. 1 disables pipelining (one request at
+	//  a time), use it for gateways which do not support several pending
+	//  transactions.
+	Tango::DevShort	pipelineDepth;
+	//	AsyncWrite:	Set this property to true to queue the PresetSingleRegister and
+	//  ForceSingleCoil writes. The commands return immediately, the writes
+	//  are done in their order by a flusher thread, consecutive writes of
+	//  the same type to adjacent addresses in one frame (FC16/FC15).
+	//  Use the AsyncWriteStatus command to check completion and errors.
+	Tango::DevBoolean	asyncWrite;
+	//	AsyncWritePeriod:	Minimum time (in ms) between two flushes of the asynchronous write
+	//  queue. Writes received meanwhile are merged in the next flush.
+	Tango::DevLong	asyncWritePeriod;
+	//	ControlConnection:	TCP protocol only. When true, the writes use a second connection to the
+	//  slave so that they never wait behind the cache thread polling.
+	Tango::DevBoolean	controlConnection;
+	//	LaneWeights:	Weights of the control (writes), interactive (client reads) and
+	//  background (cache thread) request classes. Each class gets at most
+	//  weight transactions in turn when the others are waiting.
+	//  Empty: strict priority (control first, background last).
+	//  A request waiting for more than 0.5 s is served first anyway.
+	vector<Tango::DevLong>	laneWeights;
+	//	CacheOptimize:	When true, the CacheConfig blocks are taken as the ranges to be cached.
+	//  The device polls instead the minimum set of blocks covering them: near
+	//  ranges read with the same command and period are merged and blocks
+	//  larger than one frame are split. See the CachePlan command.
+	Tango::DevBoolean	cacheOptimize;
+	//	ReadCacheSize:	Max number of ranges kept in the read-through cache. The ranges read
+	//  by ReadHoldingRegisters, ReadInputRegisters, ReadMultipleCoilsStatus,
+	//  ReadInputStatus and ReadCoilStatus and not covered by CacheConfig are
+	//  served from this cache during ReadCacheTTL ms. The least recently used
+	//  range is dropped when the cache is full. 0 disables the cache.
+	Tango::DevLong	readCacheSize;
+	//	ReadCacheTTL:	Time (in ms) a range of the read-through cache is served after its
+	//  read (see ReadCacheSize). Writes to an overlapping range drop it.
+	Tango::DevLong	readCacheTTL;
+	//	CacheMaxPeriod:	Adaptive polling. When greater than the refresh period of a block, the
+	//  period of a block whose data did not change during 4 reads is doubled,
+	//  up to CacheMaxPeriod ms. It goes back to the configured period as soon
+	//  as a change is read. ReadFifoQueue blocks are not concerned.
+	//  0 disables adaptive polling.
+	Tango::DevLong	cacheMaxPeriod;
+	//	PollingThreads:	Number of threads polling the caches (CacheConfig) of all the devices
+	//  of the server. The pool is shared, set this property at class level.
+	//  When devices ask for different values, the largest one is used.
+	//  The pool is stopped with the last device using it.
+	Tango::DevLong	pollingThreads;
+	//	PollingConnections:	TCP protocol only. Number of connections used to poll the cache
+	//  (CacheConfig). The blocks are spread over the connections and polled
+	//  concurrently by the polling threads, for slaves or gateways which
+	//  answer several connections in parallel. 1: the polling shares the
+	//  connection of the device.
+	//  With more than 1, the polling connections do not go through the
+	//  transaction scheduler: SchedulerStatistics and LaneWeights only cover
+	//  the device connection (commands, write queue).
+	Tango::DevShort	pollingConnections;
+	//	CacheSnapshotFile:	File keeping a snapshot of the cache (CacheConfig), memory mapped.
+	//  Each refresh is copied into the file. At init, the values saved with
+	//  the same CacheConfig are served (stale) until the first refresh, which
+	//  avoids reading all the devices at once when the server restarts.
+	//  One file per device. Empty: no snapshot.
+	//  The commands only serve them with CacheSnapshotServeStale.
+	string	cacheSnapshotFile;
+	//	CacheHistoryDepth:	Number of samples kept in the history ring of each cached block
+	//  (CacheConfig, except ReadFifoQueue). Each successful refresh adds a
+	//  sample dated from the start of its read. The ReadHistory command
+	//  returns the samples of a block since a date. 0 disables the history.
+	Tango::DevLong	cacheHistoryDepth;
+	//	CacheRefreshOnWrite:	When true, a cached block (CacheConfig) overlapping a written range is
+	//  read again right away instead of at its next refresh. In any case, the
+	//  block is not served from the cache between the write and the end of a
+	//  read started after it: the clients read it from the device meanwhile.
+	Tango::DevBoolean	cacheRefreshOnWrite;
+	//	CacheSnapshotMaxAge:	Oldest snapshot values loaded at init (sec). A block saved longer ago is
+	//  read from the device before being served. 0: no limit.
+	Tango::DevLong	cacheSnapshotMaxAge;
+	//	CacheSnapshotServeStale:	When true, the commands serve the snapshot values (CacheSnapshotFile) of
+	//  the blocks not refreshed yet since the start, as cached values. When false,
+	//  they read the device until the first refresh of the block (the CacheBlock
+	//  attributes show the snapshot values with an INVALID quality in any case).
+	//  ReadBlocksMaxAge never serves them.
+	Tango::DevBoolean	cacheSnapshotServeStale;
+	//	LinkModel:	Initial link cost model of CacheOptimize and ReadScattered: latency (ms)
+	//  and transfer rate (bytes/s). It is used until 8 exchanges are measured.
+	//  Empty: 1 ms and 1000000 bytes/s for TCP, 5 ms and 11520 bytes/s
+	//  (115200 bauds) for RTU. With CacheOptimize, the cache blocks planned
+	//  with it are planned again once the link is measured.
+	vector<Tango::DevDouble>	linkModel;
 
 
 //	Constructors and destructors
@@ -195,6 +322,16 @@ public:
 	//--------------------------------------------------------
 	void add_dynamic_attributes();
 
+	/**
+	 *	Attribute CacheBlock related methods
+	 *	Description: Data of one CacheConfig block (one attribute per block)
+	 *
+	 *	Data type:	Tango::DevShort
+	 *	Attr type:	Spectrum max = number of data in the block
+	 */
+	virtual void read_CacheBlock(Tango::Attribute &attr,long block);
+	virtual bool is_CacheBlock_allowed(Tango::AttReqType type);
+
 
 
 
@@ -338,6 +475,204 @@ public:
 	virtual Tango::DevShort read_exception_status();
 	virtual bool is_ReadExceptionStatus_allowed(const CORBA::Any &any);
 
+	/**
+	 *	Command ReadBlocks related method
+	 *	Description: Read several blocks of coils, inputs or registers in one call.
+	 *               Blocks found in the cache are served from it, the others are read
+	 *               with pipelined requests (see the PipelineDepth property).
+	 *
+	 *	@param argin argin[3*i] = Function code of block i (1, 2, 3 or 4)
+	 *               argin[3*i+1] = Start address of block i
+	 *               argin[3*i+2] = Number of data of block i
+	 *	@returns argout[0..n-1] = Index in argout of the first data of each block
+	 *           argout[n..] = Data of all the blocks (one value per coil or input)
+	 */
+	virtual Tango::DevVarShortArray *read_blocks(const Tango::DevVarShortArray *argin);
+	virtual bool is_ReadBlocks_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadScattered related method
+	 *	Description: Read a list of scattered coils, inputs or registers.
+	 *               The addresses are grouped into the frames which minimise the expected
+	 *               read time, according to the latency and byte rate measured on the link.
+	 *
+	 *	@param argin argin[0] = Function code (1, 2, 3 or 4)
+	 *               argin[1..n] = Addresses to read, in any order
+	 *	@returns argout[0..n-1] = Values, in the requested order
+	 */
+	virtual Tango::DevVarShortArray *read_scattered(const Tango::DevVarShortArray *argin);
+	virtual bool is_ReadScattered_allowed(const CORBA::Any &any);
+	/**
+	 *	Command AsyncWriteStatus related method
+	 *	Description: Return the status of the asynchronous write queue (AsyncWrite property).
+	 *
+	 *	@returns lvalue[0] = Writes pending (queued or being written)
+	 *           lvalue[1] = Writes queued since init (id of the last one, from 1)
+	 *           lvalue[2] = Id of the last write done (writes are done in order)
+	 *           lvalue[3] = Values written
+	 *           lvalue[4] = Frames sent
+	 *           lvalue[5] = Values which failed to be written
+	 *           lvalue[6+2*i] = Id of the failed write i (last 16 failures)
+	 *           lvalue[6+2*i+1] = Address of the failed write i
+	 *           svalue[0] = Last write error
+	 *           svalue[1+i] = Error of the failed write i
+	 */
+	virtual Tango::DevVarLongStringArray *async_write_status();
+	virtual bool is_AsyncWriteStatus_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadFileRecord related method
+	 *	Description: Read file records (function code 20).
+	 *               Several sub-requests are packed in each frame and the frames
+	 *               are pipelined (see the PipelineDepth property).
+	 *
+	 *	@param argin argin[3*i] = File number of range i
+	 *               argin[3*i+1] = Start record number of range i
+	 *               argin[3*i+2] = Number of registers of range i
+	 *	@returns argout[0..n-1] = Registers of all the ranges
+	 */
+	virtual Tango::DevVarShortArray *read_file_record(const Tango::DevVarShortArray *argin);
+	virtual bool is_ReadFileRecord_allowed(const CORBA::Any &any);
+	/**
+	 *	Command WriteFileRecord related method
+	 *	Description: Write file records (function code 21).
+	 *               Large tables are split in several frames which are pipelined.
+	 *
+	 *	@param argin argin[0] = File number
+	 *               argin[1] = Start record number
+	 *               argin[2] = Number of registers
+	 *               argin[3..n+2] = Register values
+	 */
+	virtual void write_file_record(const Tango::DevVarShortArray *argin);
+	virtual bool is_WriteFileRecord_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadFifoQueue related method
+	 *	Description: Read the content of a FIFO queue of registers (function code 24).
+	 *               When the FIFO is drained by the cache thread (ReadFifoQueue in the
+	 *               CacheConfig property), return the samples kept in the ring, oldest first.
+	 *               The samples are not removed, use ReadFifoQueueSince to get the new ones only.
+	 *
+	 *	@param argin FIFO pointer address
+	 *	@returns argout[0..n-1] = FIFO values
+	 */
+	virtual Tango::DevVarShortArray *read_fifo_queue(Tango::DevShort argin);
+	virtual bool is_ReadFifoQueue_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadFifoQueueTimed related method
+	 *	Description: Same as ReadFifoQueue, with the date at which each sample has been
+	 *               read from the FIFO.
+	 *
+	 *	@param argin FIFO pointer address
+	 *	@returns argout[2*i] = Date of sample i (seconds since epoch)
+	 *           argout[2*i+1] = Value of sample i
+	 */
+	virtual Tango::DevVarDoubleArray *read_fifo_queue_timed(Tango::DevShort argin);
+	virtual bool is_ReadFifoQueueTimed_allowed(const CORBA::Any &any);
+	/**
+	 *	Command SchedulerStatistics related method
+	 *	Description: Return the statistics of the transaction scheduler.
+	 *               All the Modbus exchanges (commands, cache thread, write queue) are
+	 *               queued and executed one at a time on the link.
+	 *
+	 *	@returns [0] = Transactions done since init
+	 *           [1] = Transactions queued or running
+	 *           [2] = Maximum number of transactions queued
+	 *           [3] = Mean time spent in the queue (sec)
+	 *           [4] = Maximum time spent in the queue (sec)
+	 *           [5] = Mean transaction duration (sec)
+	 *           [6] = Maximum transaction duration (sec)
+	 *           [7+3*i] = Transactions done in lane i (0: control, 1: interactive, 2: background)
+	 *           [8+3*i] = Mean time spent in the queue in lane i (sec)
+	 *           [9+3*i] = Maximum time spent in the queue in lane i (sec)
+	 */
+	virtual Tango::DevVarDoubleArray *scheduler_statistics();
+	virtual bool is_SchedulerStatistics_allowed(const CORBA::Any &any);
+	/**
+	 *	Command CacheStatistics related method
+	 *	Description: Return the timing statistics of the cache thread, one set of
+	 *               values per CacheConfig block.
+	 *
+	 *	@returns [8*i] = Refresh period of block i (ms), the current one with CacheMaxPeriod
+	 *           [8*i+1] = Measured mean period (ms)
+	 *           [8*i+2] = Period jitter, standard deviation (ms)
+	 *           [8*i+3] = Maximum start delay after the deadline (ms)
+	 *           [8*i+4] = Deadlines missed (overruns)
+	 *           [8*i+5] = Number of refreshes
+	 *           [8*i+6] = Age of the cached data (ms), -1 before the first read
+	 *           [8*i+7] = Duration of the last read (ms)
+	 */
+	virtual Tango::DevVarDoubleArray *cache_statistics();
+	virtual bool is_CacheStatistics_allowed(const CORBA::Any &any);
+	/**
+	 *	Command CachePlan related method
+	 *	Description: Return the blocks polled by the cache thread and, for each range of
+	 *               the CacheConfig property, the blocks serving it (see CacheOptimize).
+	 *
+	 *	@returns lvalue[4*i] = Function code of polled block i (CacheBlock<i>)
+	 *           lvalue[4*i+1] = First address of block i
+	 *           lvalue[4*i+2] = Number of data of block i
+	 *           lvalue[4*i+3] = Refresh period of block i (ms)
+	 *           svalue[j] = CacheConfig range j and the blocks serving it
+	 */
+	virtual Tango::DevVarLongStringArray *cache_plan();
+	virtual bool is_CachePlan_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadMaxAge related method
+	 *	Description: Same as ReadBlocks, but a block is served from the cache only if it was
+	 *               read without error less than max age ms ago. Otherwise it is read from
+	 *               the device. A max age of 0 always reads the device.
+	 *
+	 *	@param argin argin[0] = Max age of the cached data (ms)
+	 *               argin[3*i+1] = Function code of block i (1, 2, 3 or 4)
+	 *               argin[3*i+2] = Start address of block i
+	 *               argin[3*i+3] = Number of data of block i
+	 *	@returns argout[0..n-1] = Index in argout of the first data of each block
+	 *           argout[n..] = Data of all the blocks (one value per coil or input)
+	 */
+	virtual Tango::DevVarShortArray *read_max_age(const Tango::DevVarLongArray *argin);
+	virtual bool is_ReadMaxAge_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadCacheStatistics related method
+	 *	Description: Return the statistics of the read-through cache (see ReadCacheSize).
+	 *               All zero when the cache is disabled.
+	 *
+	 *	@returns argout[0] = Number of reads served by the read-through cache (hits)
+	 *           argout[1] = Number of misses
+	 *           argout[2] = Misses on a range older than ReadCacheTTL
+	 *           argout[3] = Ranges dropped because the cache was full
+	 *           argout[4] = Ranges dropped by a write
+	 *           argout[5] = Number of ranges in the cache
+	 *           argout[6] = Hit ratio
+	 */
+	virtual Tango::DevVarDoubleArray *read_cache_statistics();
+	virtual bool is_ReadCacheStatistics_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadHistory related method
+	 *	Description: Return the history of a cached block (see CacheHistoryDepth): the
+	 *               samples read after the given date, oldest first. Use 0 to get the
+	 *               whole ring.
+	 *
+	 *	@param argin argin[0] = Cache block index (see CachePlan)
+	 *               argin[1] = Date (seconds since epoch), samples read after it are returned
+	 *	@returns argout[0] = Number of values per sample (n)
+	 *           argout[1 + i*(n+1)] = Date of sample i (seconds since epoch)
+	 *           argout[2 + i*(n+1)] ... = Values of sample i
+	 */
+	virtual Tango::DevVarDoubleArray *read_history(const Tango::DevVarDoubleArray *argin);
+	virtual bool is_ReadHistory_allowed(const CORBA::Any &any);
+	/**
+	 *	Command ReadFifoQueueSince related method
+	 *	Description: Return the samples of a FIFO drained by the cache thread since a cursor,
+	 *               with their date. The samples are left in the ring:
+	 *               several clients can each follow the FIFO with their own cursor.
+	 *
+	 *	@param argin argin[0] = FIFO pointer address
+	 *               argin[1] = Cursor returned by the previous call (0 the first time)
+	 *	@returns argout[0] = Cursor to pass to the next call
+	 *           argout[1] = Number of samples lost since the cursor (ring too small)
+	 *           argout[2+2*i] = Date of sample i (seconds since epoch)
+	 *           argout[2+2*i+1] = Value of sample i
+	 */
+	virtual Tango::DevVarDoubleArray *read_fifo_queue_since(const Tango::DevVarDoubleArray *argin);
+	virtual bool is_ReadFifoQueueSince_allowed(const CORBA::Any &any);
 
 	//--------------------------------------------------------
 	/**
@@ -352,6 +687,27 @@ public:
 //	Additional Method prototypes
         void SendGet(unsigned char *query, short query_length, 
 	         unsigned char *response, short response_length);
+	Tango::DevVarShortArray *read_cache_block(long block);
+	Tango::DevVarShortArray *read_blocks_max_age(const Tango::DevVarShortArray *argin,long long max_age_us);
+	Tango::DevVarShortArray *read_cache_get(unsigned char fc,unsigned short adr,long nb,unsigned long &gen);
+	void read_cache_put(unsigned char fc,unsigned short adr,long nb,const Tango::DevVarShortArray *data,unsigned long gen);
+	void write_invalidate(const unsigned char *query);
+	void pipelined_invalidate(const vector<ModbusRequest> &requests,const vector<bool> &before);
+	void cache_block_invalidate(unsigned char fc,long adr,long nb);
+	void push_cache_event(long block);
+	void snapshot_cache_block(long block);
+	void cache_poll_failed(const char *reason);
+	void record_history(long block,double when);
+	Tango::DevVarDoubleArray *get_history(long block,double since);
+	void SendGetPipelined(vector<ModbusRequest> &requests);
+	void write_frames(vector<ModbusRequest> &requests,const char *where);
+	short SendGetCounted(unsigned char *query, short query_length,
+	         unsigned char *response, short max_length);
+	void read_bits(unsigned char fc,long adr,long nb,unsigned char *bits);
+	int get_fifo_block(unsigned short adr);
+	void drain_fifo(long block,double when);
+	unsigned long get_fifo_data(int block,unsigned long *cursor,vector<short> &values,vector<double> &dates);
+	Tango::DevVarShortArray *get_fifo_ring(long block);
 
 /*----- PROTECTED REGION END -----*/	//	Modbus::Additional Method prototypes
 };
@@ -426,6 +426,263 @@ CORBA::Any *ReadExceptionStatusClass::execute(Tango::DeviceImpl *device, TANGO_U
 	return insert((static_cast<Modbus *>(device))->read_exception_status());
 }
 
+//--------------------------------------------------------
+/**
+ * method : 		ReadBlocksClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadBlocksClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadBlocksClass::execute(): arrived" << endl;
+	const Tango::DevVarShortArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_blocks(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadScatteredClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadScatteredClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadScatteredClass::execute(): arrived" << endl;
+	const Tango::DevVarShortArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_scattered(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		AsyncWriteStatusClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *AsyncWriteStatusClass::execute(Tango::DeviceImpl *device, TANGO_UNUSED(const CORBA::Any &in_any))
+{
+	cout2 << "AsyncWriteStatusClass::execute(): arrived" << endl;
+	return insert((static_cast<Modbus *>(device))->async_write_status());
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadFileRecordClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadFileRecordClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadFileRecordClass::execute(): arrived" << endl;
+	const Tango::DevVarShortArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_file_record(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		WriteFileRecordClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *WriteFileRecordClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "WriteFileRecordClass::execute(): arrived" << endl;
+	const Tango::DevVarShortArray *argin;
+	extract(in_any, argin);
+	((static_cast<Modbus *>(device))->write_file_record(argin));
+	return new CORBA::Any();
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadFifoQueueClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadFifoQueueClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadFifoQueueClass::execute(): arrived" << endl;
+	Tango::DevShort argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_fifo_queue(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadFifoQueueTimedClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadFifoQueueTimedClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadFifoQueueTimedClass::execute(): arrived" << endl;
+	Tango::DevShort argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_fifo_queue_timed(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		SchedulerStatisticsClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *SchedulerStatisticsClass::execute(Tango::DeviceImpl *device, TANGO_UNUSED(const CORBA::Any &in_any))
+{
+	cout2 << "SchedulerStatisticsClass::execute(): arrived" << endl;
+	return insert((static_cast<Modbus *>(device))->scheduler_statistics());
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		CacheStatisticsClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *CacheStatisticsClass::execute(Tango::DeviceImpl *device, TANGO_UNUSED(const CORBA::Any &in_any))
+{
+	cout2 << "CacheStatisticsClass::execute(): arrived" << endl;
+	return insert((static_cast<Modbus *>(device))->cache_statistics());
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		CachePlanClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *CachePlanClass::execute(Tango::DeviceImpl *device, TANGO_UNUSED(const CORBA::Any &in_any))
+{
+	cout2 << "CachePlanClass::execute(): arrived" << endl;
+	return insert((static_cast<Modbus *>(device))->cache_plan());
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadMaxAgeClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadMaxAgeClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadMaxAgeClass::execute(): arrived" << endl;
+	const Tango::DevVarLongArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_max_age(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadCacheStatisticsClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadCacheStatisticsClass::execute(Tango::DeviceImpl *device, TANGO_UNUSED(const CORBA::Any &in_any))
+{
+	cout2 << "ReadCacheStatisticsClass::execute(): arrived" << endl;
+	return insert((static_cast<Modbus *>(device))->read_cache_statistics());
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadHistoryClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadHistoryClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadHistoryClass::execute(): arrived" << endl;
+	const Tango::DevVarDoubleArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_history(argin));
+}
+
+//--------------------------------------------------------
+/**
+ * method : 		ReadFifoQueueSinceClass::execute()
+ * description : 	method to trigger the execution of the command.
+ *
+ * @param	device	The device on which the command must be executed
+ * @param	in_any	The command input data
+ *
+ *	returns The command output data (packed in the Any object)
+ */
+//--------------------------------------------------------
+CORBA::Any *ReadFifoQueueSinceClass::execute(Tango::DeviceImpl *device, const CORBA::Any &in_any)
+{
+	cout2 << "ReadFifoQueueSinceClass::execute(): arrived" << endl;
+	const Tango::DevVarDoubleArray *argin;
+	extract(in_any, argin);
+	return insert((static_cast<Modbus *>(device))->read_fifo_queue_since(argin));
+}
+
 
 //===================================================================
 //	Properties management
@@ -550,7 +807,7 @@ void ModbusClass::set_default_property()
 	else
 		add_wiz_dev_prop(prop_name, prop_desc);
 	prop_name = "CacheConfig";
-	prop_desc = "Describe which data has to be cached.\nEach set of cached data is described by 3 parameters which are:\n1 - Command to be used to read data (ReadHoldingRegisters, ReadInputStatus\nReadInutRegisters or ReadMultipleCoilStatus)\n2 - First address to be read\n3 - Number of data to read";
+	prop_desc = "Describe which data has to be cached.\nEach set of cached data is described by 3 parameters which are:\n1 - Command to be used to read data (ReadHoldingRegisters, ReadInputStatus\nReadInutRegisters or ReadMultipleCoilStatus)\n2 - First address to be read\n3 - Number of data to read\nWith ReadFifoQueue, 2 is the FIFO pointer address and 3 the size\nof the ring keeping the samples drained from the FIFO.\nAn optional 4th parameter period[:phase] (in ms) gives the block its own\nrefresh period, the first refresh being delayed by phase. Blocks without\nperiod are refreshed every CacheSleep ms.\nReadMultipleCoilStatus and ReadInputStatus blocks are kept as packed bits.";
 	prop_def  = "";
 	vect_data.clear();
 	if (prop_def.length()>0)
@@ -687,6 +944,283 @@ void ModbusClass::set_default_property()
 	}
 	else
 		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheEvents";
+	prop_desc = "Set this property to true to push change and archive events for\nthe cached data. One spectrum attribute (CacheBlock<n>) is created\nper CacheConfig block and an event is pushed each time the cache\nthread detects a change in the block data.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheEventAbsChange";
+	prop_desc = "Absolute change (deadband) required on at least one register of a\ncached block before an event is pushed. 0 means any change.";
+	prop_def  = "0";
+	vect_data.clear();
+	vect_data.push_back("0");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheEventRelChange";
+	prop_desc = "Relative change (in %) required on at least one register of a\ncached block before an event is pushed. 0 means any change.";
+	prop_def  = "0";
+	vect_data.clear();
+	vect_data.push_back("0");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "PipelineDepth";
+	prop_desc = "Maximum number of requests in flight on the TCP connection for\nthe multi-request commands (ReadBlocks). Each request gets its own\nMBAP transaction identifier. 1 disables pipelining (one request at\na time), use it for gateways which do not support several pending\ntransactions.";
+	prop_def  = "1";
+	vect_data.clear();
+	vect_data.push_back("1");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "AsyncWrite";
+	prop_desc = "Set this property to true to queue the PresetSingleRegister and\nForceSingleCoil writes. The commands return immediately, the writes\nare done in their order by a flusher thread, consecutive writes of\nthe same type to adjacent addresses in one frame (FC16/FC15).\nUse the AsyncWriteStatus command to check completion and errors.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "AsyncWritePeriod";
+	prop_desc = "Minimum time (in ms) between two flushes of the asynchronous write\nqueue. Writes received meanwhile are merged in the next flush.";
+	prop_def  = "20";
+	vect_data.clear();
+	vect_data.push_back("20");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "ControlConnection";
+	prop_desc = "TCP protocol only. When true, the writes use a second connection to the\nslave so that they never wait behind the cache thread polling.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "LaneWeights";
+	prop_desc = "Weights of the control (writes), interactive (client reads) and\nbackground (cache thread) request classes. Each class gets at most\nweight transactions in turn when the others are waiting.\nEmpty: strict priority (control first, background last).\nA request waiting for more than 0.5 s is served first anyway.";
+	prop_def  = "";
+	vect_data.clear();
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheOptimize";
+	prop_desc = "When true, the CacheConfig blocks are taken as the ranges to be cached.\nThe device polls instead the minimum set of blocks covering them: near\nranges read with the same command and period are merged and blocks\nlarger than one frame are split. See the CachePlan command.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "ReadCacheSize";
+	prop_desc = "Max number of ranges kept in the read-through cache. The ranges read\nby ReadHoldingRegisters, ReadInputRegisters, ReadMultipleCoilsStatus,\nReadInputStatus and ReadCoilStatus and not covered by CacheConfig are\nserved from this cache during ReadCacheTTL ms. The least recently used\nrange is dropped when the cache is full. 0 disables the cache.";
+	prop_def  = "0";
+	vect_data.clear();
+	vect_data.push_back("0");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "ReadCacheTTL";
+	prop_desc = "Time (in ms) a range of the read-through cache is served after its\nread (see ReadCacheSize). Writes to an overlapping range drop it.";
+	prop_def  = "1000";
+	vect_data.clear();
+	vect_data.push_back("1000");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheMaxPeriod";
+	prop_desc = "Adaptive polling. When greater than the refresh period of a block, the\nperiod of a block whose data did not change during 4 reads is doubled,\nup to CacheMaxPeriod ms. It goes back to the configured period as soon\nas a change is read. ReadFifoQueue blocks are not concerned.\n0 disables adaptive polling.";
+	prop_def  = "0";
+	vect_data.clear();
+	vect_data.push_back("0");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "PollingThreads";
+	prop_desc = "Number of threads polling the caches (CacheConfig) of all the devices\nof the server. The pool is shared, set this property at class level.\nWhen devices ask for different values, the largest one is used.\nThe pool is stopped with the last device using it.";
+	prop_def  = "1";
+	vect_data.clear();
+	vect_data.push_back("1");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "PollingConnections";
+	prop_desc = "TCP protocol only. Number of connections used to poll the cache\n(CacheConfig). The blocks are spread over the connections and polled\nconcurrently by the polling threads, for slaves or gateways which\nanswer several connections in parallel. 1: the polling shares the\nconnection of the device.\nWith more than 1, the polling connections do not go through the\ntransaction scheduler: SchedulerStatistics and LaneWeights only cover\nthe device connection (commands, write queue).";
+	prop_def  = "1";
+	vect_data.clear();
+	vect_data.push_back("1");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheSnapshotFile";
+	prop_desc = "File keeping a snapshot of the cache (CacheConfig), memory mapped.\nEach refresh is copied into the file. At init, the values saved with\nthe same CacheConfig are served (stale) until the first refresh, which\navoids reading all the devices at once when the server restarts.\nOne file per device. Empty: no snapshot.\nThe commands only serve them with CacheSnapshotServeStale.";
+	prop_def  = "";
+	vect_data.clear();
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheHistoryDepth";
+	prop_desc = "Number of samples kept in the history ring of each cached block\n(CacheConfig, except ReadFifoQueue). Each successful refresh adds a\nsample dated from the start of its read. The ReadHistory command\nreturns the samples of a block since a date. 0 disables the history.";
+	prop_def  = "0";
+	vect_data.clear();
+	vect_data.push_back("0");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheRefreshOnWrite";
+	prop_desc = "When true, a cached block (CacheConfig) overlapping a written range is\nread again right away instead of at its next refresh. In any case, the\nblock is not served from the cache between the write and the end of a\nread started after it: the clients read it from the device meanwhile.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheSnapshotMaxAge";
+	prop_desc = "Oldest snapshot values loaded at init (sec). A block saved longer ago is\nread from the device before being served. 0: no limit.";
+	prop_def  = "3600";
+	vect_data.clear();
+	vect_data.push_back("3600");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "CacheSnapshotServeStale";
+	prop_desc = "When true, the commands serve the snapshot values (CacheSnapshotFile) of\nthe blocks not refreshed yet since the start, as cached values. When false,\nthey read the device until the first refresh of the block (the CacheBlock\nattributes show the snapshot values with an INVALID quality in any case).\nReadBlocksMaxAge never serves them.";
+	prop_def  = "false";
+	vect_data.clear();
+	vect_data.push_back("false");
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
+	prop_name = "LinkModel";
+	prop_desc = "Initial link cost model of CacheOptimize and ReadScattered: latency (ms)\nand transfer rate (bytes/s). It is used until 8 exchanges are measured.\nEmpty: 1 ms and 1000000 bytes/s for TCP, 5 ms and 11520 bytes/s\n(115200 bauds) for RTU. With CacheOptimize, the cache blocks planned\nwith it are planned again once the link is measured.";
+	prop_def  = "";
+	vect_data.clear();
+	if (prop_def.length()>0)
+	{
+		Tango::DbDatum	data(prop_name);
+		data << vect_data ;
+		dev_def_prop.push_back(data);
+		add_wiz_dev_prop(prop_name, prop_desc,  prop_def);
+	}
+	else
+		add_wiz_dev_prop(prop_name, prop_desc);
 }
 
 //--------------------------------------------------------
@@ -964,6 +1498,132 @@ void ModbusClass::command_factory()
 			Tango::OPERATOR);
 	command_list.push_back(pReadExceptionStatusCmd);
 
+	//	Command ReadBlocks
+	ReadBlocksClass	*pReadBlocksCmd =
+		new ReadBlocksClass("ReadBlocks",
+			Tango::DEVVAR_SHORTARRAY, Tango::DEVVAR_SHORTARRAY,
+			"argin[3*i] = Function code of block i (1, 2, 3 or 4)\nargin[3*i+1] = Start address of block i\nargin[3*i+2] = Number of data of block i",
+			"argout[0..n-1] = Index in argout of the first data of each block\nargout[n..] = Data of all the blocks (one value per coil or input)",
+			Tango::OPERATOR);
+	command_list.push_back(pReadBlocksCmd);
+
+	//	Command ReadScattered
+	ReadScatteredClass	*pReadScatteredCmd =
+		new ReadScatteredClass("ReadScattered",
+			Tango::DEVVAR_SHORTARRAY, Tango::DEVVAR_SHORTARRAY,
+			"argin[0] = Function code (1, 2, 3 or 4)\nargin[1..n] = Addresses to read, in any order",
+			"argout[0..n-1] = Values, in the requested order",
+			Tango::OPERATOR);
+	command_list.push_back(pReadScatteredCmd);
+
+	//	Command AsyncWriteStatus
+	AsyncWriteStatusClass	*pAsyncWriteStatusCmd =
+		new AsyncWriteStatusClass("AsyncWriteStatus",
+			Tango::DEV_VOID, Tango::DEVVAR_LONGSTRINGARRAY,
+			"",
+			"lvalue[0] = Writes pending (queued or being written)\nlvalue[1] = Writes queued since init (id of the last one, from 1)\nlvalue[2] = Id of the last write done (writes are done in order)\nlvalue[3] = Values written\nlvalue[4] = Frames sent\nlvalue[5] = Values which failed to be written\nlvalue[6+2*i] = Id of the failed write i (last 16 failures)\nlvalue[6+2*i+1] = Address of the failed write i\nsvalue[0] = Last write error\nsvalue[1+i] = Error of the failed write i",
+			Tango::OPERATOR);
+	command_list.push_back(pAsyncWriteStatusCmd);
+
+	//	Command ReadFileRecord
+	ReadFileRecordClass	*pReadFileRecordCmd =
+		new ReadFileRecordClass("ReadFileRecord",
+			Tango::DEVVAR_SHORTARRAY, Tango::DEVVAR_SHORTARRAY,
+			"argin[3*i] = File number of range i\nargin[3*i+1] = Start record number of range i\nargin[3*i+2] = Number of registers of range i",
+			"argout[0..n-1] = Registers of all the ranges",
+			Tango::OPERATOR);
+	command_list.push_back(pReadFileRecordCmd);
+
+	//	Command WriteFileRecord
+	WriteFileRecordClass	*pWriteFileRecordCmd =
+		new WriteFileRecordClass("WriteFileRecord",
+			Tango::DEVVAR_SHORTARRAY, Tango::DEV_VOID,
+			"argin[0] = File number\nargin[1] = Start record number\nargin[2] = Number of registers\nargin[3..n+2] = Register values",
+			"",
+			Tango::OPERATOR);
+	command_list.push_back(pWriteFileRecordCmd);
+
+	//	Command ReadFifoQueue
+	ReadFifoQueueClass	*pReadFifoQueueCmd =
+		new ReadFifoQueueClass("ReadFifoQueue",
+			Tango::DEV_SHORT, Tango::DEVVAR_SHORTARRAY,
+			"FIFO pointer address",
+			"argout[0..n-1] = FIFO values",
+			Tango::OPERATOR);
+	command_list.push_back(pReadFifoQueueCmd);
+
+	//	Command ReadFifoQueueTimed
+	ReadFifoQueueTimedClass	*pReadFifoQueueTimedCmd =
+		new ReadFifoQueueTimedClass("ReadFifoQueueTimed",
+			Tango::DEV_SHORT, Tango::DEVVAR_DOUBLEARRAY,
+			"FIFO pointer address",
+			"argout[2*i] = Date of sample i (seconds since epoch)\nargout[2*i+1] = Value of sample i",
+			Tango::OPERATOR);
+	command_list.push_back(pReadFifoQueueTimedCmd);
+
+	//	Command SchedulerStatistics
+	SchedulerStatisticsClass	*pSchedulerStatisticsCmd =
+		new SchedulerStatisticsClass("SchedulerStatistics",
+			Tango::DEV_VOID, Tango::DEVVAR_DOUBLEARRAY,
+			"",
+			"[0] = Transactions done since init\n[1] = Transactions queued or running\n[2] = Maximum number of transactions queued\n[3] = Mean time spent in the queue (sec)\n[4] = Maximum time spent in the queue (sec)\n[5] = Mean transaction duration (sec)\n[6] = Maximum transaction duration (sec)\n[7+3*i] = Transactions done in lane i (0: control, 1: interactive, 2: background)\n[8+3*i] = Mean time spent in the queue in lane i (sec)\n[9+3*i] = Maximum time spent in the queue in lane i (sec)",
+			Tango::OPERATOR);
+	command_list.push_back(pSchedulerStatisticsCmd);
+
+	//	Command CacheStatistics
+	CacheStatisticsClass	*pCacheStatisticsCmd =
+		new CacheStatisticsClass("CacheStatistics",
+			Tango::DEV_VOID, Tango::DEVVAR_DOUBLEARRAY,
+			"",
+			"[8*i] = Refresh period of block i (ms), the current one with CacheMaxPeriod\n[8*i+1] = Measured mean period (ms)\n[8*i+2] = Period jitter, standard deviation (ms)\n[8*i+3] = Maximum start delay after the deadline (ms)\n[8*i+4] = Deadlines missed (overruns)\n[8*i+5] = Number of refreshes\n[8*i+6] = Age of the cached data (ms), -1 before the first read\n[8*i+7] = Duration of the last read (ms)",
+			Tango::OPERATOR);
+	command_list.push_back(pCacheStatisticsCmd);
+
+	//	Command CachePlan
+	CachePlanClass	*pCachePlanCmd =
+		new CachePlanClass("CachePlan",
+			Tango::DEV_VOID, Tango::DEVVAR_LONGSTRINGARRAY,
+			"",
+			"lvalue[4*i] = Function code of polled block i (CacheBlock<i>)\nlvalue[4*i+1] = First address of block i\nlvalue[4*i+2] = Number of data of block i\nlvalue[4*i+3] = Refresh period of block i (ms)\nsvalue[j] = CacheConfig range j and the blocks serving it",
+			Tango::OPERATOR);
+	command_list.push_back(pCachePlanCmd);
+
+	//	Command ReadMaxAge
+	ReadMaxAgeClass	*pReadMaxAgeCmd =
+		new ReadMaxAgeClass("ReadMaxAge",
+			Tango::DEVVAR_LONGARRAY, Tango::DEVVAR_SHORTARRAY,
+			"argin[0] = Max age of the cached data (ms)\nargin[3*i+1] = Function code of block i (1, 2, 3 or 4)\nargin[3*i+2] = Start address of block i\nargin[3*i+3] = Number of data of block i",
+			"argout[0..n-1] = Index in argout of the first data of each block\nargout[n..] = Data of all the blocks (one value per coil or input)",
+			Tango::OPERATOR);
+	command_list.push_back(pReadMaxAgeCmd);
+
+	//	Command ReadCacheStatistics
+	ReadCacheStatisticsClass	*pReadCacheStatisticsCmd =
+		new ReadCacheStatisticsClass("ReadCacheStatistics",
+			Tango::DEV_VOID, Tango::DEVVAR_DOUBLEARRAY,
+			"",
+			"argout[0] = Number of reads served by the read-through cache (hits)\nargout[1] = Number of misses\nargout[2] = Misses on a range older than ReadCacheTTL\nargout[3] = Ranges dropped because the cache was full\nargout[4] = Ranges dropped by a write\nargout[5] = Number of ranges in the cache\nargout[6] = Hit ratio",
+			Tango::OPERATOR);
+	command_list.push_back(pReadCacheStatisticsCmd);
+
+	//	Command ReadHistory
+	ReadHistoryClass	*pReadHistoryCmd =
+		new ReadHistoryClass("ReadHistory",
+			Tango::DEVVAR_DOUBLEARRAY, Tango::DEVVAR_DOUBLEARRAY,
+			"argin[0] = Cache block index (see CachePlan)\nargin[1] = Date (seconds since epoch), samples read after it are returned",
+			"argout[0] = Number of values per sample (n)\nargout[1 + i*(n+1)] = Date of sample i (seconds since epoch)\nargout[2 + i*(n+1)] ... = Values of sample i",
+			Tango::OPERATOR);
+	command_list.push_back(pReadHistoryCmd);
+
+	//	Command ReadFifoQueueSince
+	ReadFifoQueueSinceClass	*pReadFifoQueueSinceCmd =
+		new ReadFifoQueueSinceClass("ReadFifoQueueSince",
+			Tango::DEVVAR_DOUBLEARRAY, Tango::DEVVAR_DOUBLEARRAY,
+			"argin[0] = FIFO pointer address\nargin[1] = Cursor returned by the previous call (0 the first time)",
+			"argout[0] = Cursor to pass to the next call\nargout[1] = Number of samples lost since the cursor (ring too small)\nargout[2+2*i] = Date of sample i (seconds since epoch)\nargout[2+2*i+1] = Value of sample i",
+			Tango::OPERATOR);
+	command_list.push_back(pReadFifoQueueSinceCmd);
+
 	/*----- PROTECTED REGION ID(ModbusClass::command_factory_after) ENABLED START -----*/
 	
 	//	Add your own code
@@ -53,6 +53,20 @@ namespace Modbus_ns
 {
 /*----- PROTECTED REGION ID(ModbusClass::classes for dynamic creation) ENABLED START -----*/
 
+//	Attribute CacheBlock class definition (one instance per CacheConfig block)
+class CacheBlockAttrib: public Tango::SpectrumAttr
+{
+public:
+	CacheBlockAttrib(const string &att_name,long block,long max_x):SpectrumAttr(att_name.c_str(),
+			Tango::DEV_SHORT, Tango::READ, max_x),block_idx(block) {};
+	~CacheBlockAttrib() {};
+	virtual void read(Tango::DeviceImpl *dev,Tango::Attribute &att)
+		{(static_cast<Modbus *>(dev))->read_CacheBlock(att,block_idx);}
+	virtual bool is_allowed(Tango::DeviceImpl *dev,Tango::AttReqType ty)
+		{return (static_cast<Modbus *>(dev))->is_CacheBlock_allowed(ty);}
+protected:
+	long	block_idx;
+};
 
 /*----- PROTECTED REGION END -----*/	//	ModbusClass::classes for dynamic creation
 
@@ -381,6 +395,314 @@ public:
 	{return (static_cast<Modbus *>(dev))->is_ReadExceptionStatus_allowed(any);}
 };
 
+//	Command ReadBlocks class definition
+class ReadBlocksClass : public Tango::Command
+{
+public:
+	ReadBlocksClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadBlocksClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadBlocksClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadBlocks_allowed(any);}
+};
+//	Command ReadScattered class definition
+class ReadScatteredClass : public Tango::Command
+{
+public:
+	ReadScatteredClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadScatteredClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadScatteredClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadScattered_allowed(any);}
+};
+//	Command AsyncWriteStatus class definition
+class AsyncWriteStatusClass : public Tango::Command
+{
+public:
+	AsyncWriteStatusClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	AsyncWriteStatusClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~AsyncWriteStatusClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_AsyncWriteStatus_allowed(any);}
+};
+//	Command ReadFileRecord class definition
+class ReadFileRecordClass : public Tango::Command
+{
+public:
+	ReadFileRecordClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadFileRecordClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadFileRecordClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadFileRecord_allowed(any);}
+};
+//	Command WriteFileRecord class definition
+class WriteFileRecordClass : public Tango::Command
+{
+public:
+	WriteFileRecordClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	WriteFileRecordClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~WriteFileRecordClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_WriteFileRecord_allowed(any);}
+};
+//	Command ReadFifoQueue class definition
+class ReadFifoQueueClass : public Tango::Command
+{
+public:
+	ReadFifoQueueClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadFifoQueueClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadFifoQueueClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadFifoQueue_allowed(any);}
+};
+//	Command ReadFifoQueueTimed class definition
+class ReadFifoQueueTimedClass : public Tango::Command
+{
+public:
+	ReadFifoQueueTimedClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadFifoQueueTimedClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadFifoQueueTimedClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadFifoQueueTimed_allowed(any);}
+};
+//	Command SchedulerStatistics class definition
+class SchedulerStatisticsClass : public Tango::Command
+{
+public:
+	SchedulerStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	SchedulerStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~SchedulerStatisticsClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_SchedulerStatistics_allowed(any);}
+};
+//	Command CacheStatistics class definition
+class CacheStatisticsClass : public Tango::Command
+{
+public:
+	CacheStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	CacheStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~CacheStatisticsClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_CacheStatistics_allowed(any);}
+};
+//	Command CachePlan class definition
+class CachePlanClass : public Tango::Command
+{
+public:
+	CachePlanClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	CachePlanClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~CachePlanClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_CachePlan_allowed(any);}
+};
+//	Command ReadMaxAge class definition
+class ReadMaxAgeClass : public Tango::Command
+{
+public:
+	ReadMaxAgeClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadMaxAgeClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadMaxAgeClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadMaxAge_allowed(any);}
+};
+//	Command ReadCacheStatistics class definition
+class ReadCacheStatisticsClass : public Tango::Command
+{
+public:
+	ReadCacheStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadCacheStatisticsClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadCacheStatisticsClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadCacheStatistics_allowed(any);}
+};
+//	Command ReadHistory class definition
+class ReadHistoryClass : public Tango::Command
+{
+public:
+	ReadHistoryClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadHistoryClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadHistoryClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadHistory_allowed(any);}
+};
+//	Command ReadFifoQueueSince class definition
+class ReadFifoQueueSinceClass : public Tango::Command
+{
+public:
+	ReadFifoQueueSinceClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out,
+				   const char        *in_desc,
+				   const char        *out_desc,
+				   Tango::DispLevel  level)
+	:Command(name,in,out,in_desc,out_desc, level)	{};
+
+	ReadFifoQueueSinceClass(const char   *name,
+	               Tango::CmdArgType in,
+				   Tango::CmdArgType out)
+	:Command(name,in,out)	{};
+	~ReadFifoQueueSinceClass() {};
+	
+	virtual CORBA::Any *execute (Tango::DeviceImpl *dev, const CORBA::Any &any);
+	virtual bool is_allowed (Tango::DeviceImpl *dev, const CORBA::Any &any)
+	{return (static_cast<Modbus *>(dev))->is_ReadFifoQueueSince_allowed(any);}
+};
 
 /**
  *	The ModbusClass singleton definition
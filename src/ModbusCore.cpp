@@ -68,6 +68,23 @@ const char *modbusError[] = {
 
 const int nbError = sizeof(modbusError)/sizeof(char *);
 
+// ---------------------------------------------------------------------
+// Modbus abstract class
+// ---------------------------------------------------------------------
+
+void ModbusCore::SendGetPipelined (vector<ModbusRequest> &requests) {
+
+  for (size_t i=0; i<requests.size(); i++) {
+    if (requests[i].done)
+      continue;
+    requests[i].sent = true;
+    SendGet(requests[i].query,requests[i].query_length,
+            requests[i].response,requests[i].response_length);
+    requests[i].done = true;
+  }
+
+}
+
 // ---------------------------------------------------------------------
 // Modbus RTU class
 // ---------------------------------------------------------------------
@@ -141,10 +158,34 @@ void ModbusRTU::SendGet (unsigned char *query,
 
 // -------------------------------------------------------
 
+short ModbusRTU::SendGetCounted (unsigned char *query, 
+	                 short query_length,
+	                 unsigned char *response, 
+	                 short max_length) {
+
+  short response_length;
+
+  try {
+    SendGetInternal(query,query_length,response,max_length,&response_length);
+    state = Tango::ON;
+    lastError = "";
+  } catch(Tango::DevFailed &e) {
+    state = Tango::UNKNOWN;
+    lastError = e.errors[0].desc;
+    throw e;
+  }
+
+  return response_length;
+
+}
+
+// -------------------------------------------------------
+
 void ModbusRTU::SendGetInternal (unsigned char *query, 
 	                 short query_length,
 	                 unsigned char *response, 
-	                 short response_length) {
+	                 short response_length,
+	                 short *counted_length) {
 
   unsigned char frame[MAX_FRAME_SIZE], crc[2];
 
@@ -212,13 +253,47 @@ void ModbusRTU::SendGetInternal (unsigned char *query,
   // Function code echoed correctly, read rest of response
 
   size_t ncharexp = (response_length+1);
+  size_t nhead = 0;
+
+  if( counted_length!=NULL ) {
+
+    // Variable length answer, read the byte count first
+    argin << (Tango::DevLong)( (2 << 8) | SL_NCHAR );
+    argout = serialDS->command_inout("DevSerReadChar",argin);
+    argout >> vcharr;
+    if( vcharr.size()!=2 ) {
+      LogError("Missing char",query,query_length,frame,vcharr.size()+2);
+      Tango::Except::throw_exception(
+        (const char *)"ModbusRTU::error_read",
+        (const char *)"Unexpected message size (missing char)",
+        (const char *)"ModbusRTU::SendGet");
+    }
+    frame[2] = vcharr[0];
+    frame[3] = vcharr[1];
+    nhead = 2;
+
+    int count = (frame[2] << 8) + frame[3];
+    if( count+3>response_length ) {
+      char errStr[256];
+      sprintf(errStr,"Unexpected response length [%d bytes, %d max]",count+3,response_length);
+      Tango::Except::throw_exception(
+        (const char *)"ModbusRTU::error_read",
+        (const char *)errStr,
+        (const char *)"ModbusRTU::SendGet");
+    }
+    response_length = count+3;
+    *counted_length = response_length;
+    ncharexp = count+2;
+
+  }
+
   argin << (Tango::DevLong)( (ncharexp << 8) | SL_NCHAR );
   argout = serialDS->command_inout("DevSerReadChar",argin);
   argout >> vcharr;
   size_t nchar = vcharr.size();
 
   for(size_t i=0;i<nchar;i++)
-    frame[2+i] = vcharr[i];
+    frame[2+nhead+i] = vcharr[i];
 	
   if( ncharexp != nchar ) {
     LogError("Missing char",query,query_length,frame,nchar+2);
@@ -228,9 +303,10 @@ void ModbusRTU::SendGetInternal (unsigned char *query,
        	  (const char *)"ModbusRTU::Send");  
   }
 
+  nchar += nhead;
   CalculateCRC(frame, nchar, crc);
 
-  if ((crc[0] != frame[nchar]) && (crc[1] != frame[nchar+1]))
+  if ((crc[0] != frame[nchar]) || (crc[1] != frame[nchar+1]))
   {	
     LogError("Invalid CRC",query,query_length,frame,response_length+3);
     Tango::Except::throw_exception(
@@ -424,7 +500,7 @@ void ModbusRTU::LogError(const char *msg,unsigned char *inFrame,short inFrameLgt
 
 // -------------------------------------------------------
 
-ModbusTCP::ModbusTCP(std::string ipHost,short port,short node,double tcpTimeout,double connectTimeout,bool tcpNoDelay,bool tcpQuickAck, bool tcpKeepAlive) {
+ModbusTCP::ModbusTCP(std::string ipHost,short port,short node,double tcpTimeout,double connectTimeout,bool tcpNoDelay,bool tcpQuickAck, bool tcpKeepAlive, short pipelineDepth) {
 
   this->ipHost = ipHost;
   this->tcpTimeout = (int)(tcpTimeout * 1000.0);
@@ -434,6 +510,8 @@ ModbusTCP::ModbusTCP(std::string ipHost,short port,short node,double tcpTimeout,
   this->tcpKeepAlive = tcpKeepAlive;
   this->node = node;
   this->port = port;
+  this->pipelineDepth = pipelineDepth;
+  transactionId = 0;
   lastError = "";
   sock_ = -1;
   tickStart = -1;
@@ -764,13 +842,28 @@ bool ModbusTCP::IsConnected() {
 void ModbusTCP::Send ( unsigned char *query, 
   	               short query_length) {
 
+  SendFrame(query,query_length);
+
+}
+
+// -------------------------------------------------------
+
+// Every frame takes its transaction identifier from the same
+// counter as the pipelined ones, so that a late answer is never
+// taken for the answer of another frame. Return the identifier.
+
+unsigned short ModbusTCP::SendFrame ( unsigned char *query, 
+  	               short query_length) {
+
   unsigned char frame[MAX_FRAME_SIZE];
   int iframe;
+  unsigned short tid = ++transactionId;
 
   iframe=0;
-  frame[iframe++] = node;
+  frame[iframe++] = tid >> 8;
+  frame[iframe++] = tid & 0xff;
 
-  for(int i=0; i<4; i++)
+  for(int i=0; i<3; i++)
     frame[iframe++] = 0;
 
   frame[iframe++] = query_length+1; // number of bytes
@@ -800,9 +893,34 @@ void ModbusTCP::Send ( unsigned char *query,
         (const char *)lastError.c_str(),
         (const char *)"ModbusTCP::Send (write)");
   }
+
+  return tid;
   
 }
 
+// -------------------------------------------------------
+// Read the answer of the frame tid. The answers of previous
+// frames (arrived after their timeout) are dropped. Return the
+// number of bytes read, as Read().
+
+int ModbusTCP::ReadAnswer(unsigned short tid, unsigned char *frame) {
+
+  int nbRead = Read( sock_ , (char *)frame , MAX_FRAME_SIZE , tcpTimeout );
+
+  while( nbRead>=7 && ((frame[0] << 8) | frame[1])!=tid ) {
+    int frameLength = 6 + ((frame[4] << 8) | frame[5]);
+    if( frameLength<nbRead ) {
+      memmove(frame,frame+frameLength,nbRead-frameLength);
+      nbRead -= frameLength;
+    } else {
+      nbRead = Read( sock_ , (char *)frame , MAX_FRAME_SIZE , tcpTimeout );
+    }
+  }
+
+  return nbRead;
+
+}
+
 // -------------------------------------------------------
 
 time_t ModbusTCP::get_ticks() {
@@ -831,16 +949,16 @@ void ModbusTCP::SendGet (unsigned char *query,
 
   unsigned char frame[MAX_FRAME_SIZE];
 
-  Send(query,query_length);
+  unsigned short tid = SendFrame(query,query_length);
 
-  int nbRead = Read( sock_ , (char *)frame , MAX_FRAME_SIZE , tcpTimeout );
+  int nbRead = ReadAnswer(tid,frame);
 
   if( nbRead==0 ) {
     // Connection 'gracefully' closed by peer !
     // Retry
     Disconnect(sock_);
-    Send(query,query_length);
-    nbRead = Read( sock_ , (char *)frame , MAX_FRAME_SIZE , tcpTimeout );
+    tid = SendFrame(query,query_length);
+    nbRead = ReadAnswer(tid,frame);
   }
 
   if( nbRead < 0 ) {
@@ -894,3 +1012,246 @@ void ModbusTCP::SendGet (unsigned char *query,
 
 }
 
+// -------------------------------------------------------
+
+void ModbusTCP::SendGetPipelined (vector<ModbusRequest> &requests) {
+
+  if( pipelineDepth<=1 ) {
+    ModbusCore::SendGetPipelined(requests);
+    return;
+  }
+
+  vector<size_t> todo;
+  for (size_t i=0; i<requests.size(); i++)
+    if( !requests[i].done ) todo.push_back(i);
+  if( todo.empty() )
+    return;
+
+  // Connect
+  if(!IsConnected()) 
+  {
+    if( !Connect(&sock_) ) 
+    {
+      Tango::Except::throw_exception(
+        (const char *)"ModbusTCP::error_write",
+        (const char *)lastError.c_str(),
+        (const char *)"ModbusTCP::SendGetPipelined (connect)");
+    }
+  }
+
+  // Requests in flight, indexed by MBAP transaction identifier
+  map<unsigned short,size_t> inFlight;
+  unsigned char buf[2*MAX_FRAME_SIZE];
+  int bufLength = 0;
+  size_t next = 0;
+  string modbusErr;
+
+  while( next<todo.size() || !inFlight.empty() ) {
+
+    // Fill up the pipeline
+    while( next<todo.size() && (int)inFlight.size()<pipelineDepth ) {
+
+      ModbusRequest &req = requests[todo[next]];
+      unsigned char frame[MAX_FRAME_SIZE+7];
+      unsigned short tid = ++transactionId;
+      int iframe = 0;
+
+      frame[iframe++] = tid >> 8;
+      frame[iframe++] = tid & 0xff;
+      frame[iframe++] = 0; // Protocol identifier
+      frame[iframe++] = 0;
+      frame[iframe++] = (req.query_length+1) >> 8;
+      frame[iframe++] = (req.query_length+1) & 0xff;
+      frame[iframe++] = node;
+      for (int i=0; i<req.query_length; i++)
+        frame[iframe++] = req.query[i];
+
+      if( Write( sock_ , (char *)frame , iframe , tcpTimeout ) < 0 ) 
+      {
+        // Transmission error, we need to reconnect
+        Disconnect(sock_);
+        Tango::Except::throw_exception(
+          (const char *)"ModbusTCP::error_write",
+          (const char *)lastError.c_str(),
+          (const char *)"ModbusTCP::SendGetPipelined (write)");
+      }
+
+      req.sent = true;
+      inFlight[tid] = todo[next];
+      next++;
+
+    }
+
+    // Wait for answers
+    int nbRead = Read( sock_ , (char *)buf+bufLength , sizeof(buf)-bufLength , tcpTimeout );
+
+    if( nbRead<=0 ) {
+      // Transmission error or connection closed by peer, the answers
+      // still in flight are lost, we need to reconnect
+      if( nbRead==0 ) lastError = "ModbusTCP: Connection closed by peer";
+      Disconnect(sock_);
+      Tango::Except::throw_exception(
+        (const char *)"ModbusTCP::error_read",
+        (const char *)lastError.c_str(),
+        (const char *)"ModbusTCP::SendGetPipelined");
+    }
+    bufLength += nbRead;
+
+    // Extract the complete answers (MBAP header + PDU)
+    while( bufLength>=7 ) {
+
+      int frameLength = 6 + ((buf[4] << 8) | buf[5]);
+      if( frameLength<9 || frameLength>MAX_FRAME_SIZE ) {
+        char errStr[256];
+        sprintf(errStr,"Unexpected MBAP length [%d bytes]",frameLength-6);
+        Disconnect(sock_);
+        Tango::Except::throw_exception(
+          (const char *)"ModbusTCP::error_read",
+          (const char *)errStr,
+          (const char *)"ModbusTCP::SendGetPipelined");
+      }
+      if( bufLength<frameLength )
+        break;
+
+      unsigned short tid = (buf[0] << 8) | buf[1];
+      map<unsigned short,size_t>::iterator it = inFlight.find(tid);
+
+      // Answers with an unknown transaction identifier are late answers
+      // of a previous exchange, they are dropped
+      if( it!=inFlight.end() ) {
+
+        ModbusRequest &req = requests[it->second];
+        inFlight.erase(it);
+
+        if( buf[7]==(req.query[0] | 0x80) ) {
+
+          // We got a modbus error, report the first one once all
+          // answers are received
+          if( modbusErr.empty() ) {
+            short errCode = buf[8];
+            if( errCode<=0 || errCode>=nbError ) {
+              char errStr[256];
+              sprintf(errStr,"Unknow modbus error code [%d]",errCode);
+              modbusErr = errStr;
+            } else {
+              modbusErr = modbusError[errCode];
+            }
+          }
+
+        } else if( buf[7]!=req.query[0] ) {
+
+          if( modbusErr.empty() ) {
+            char errStr[256];
+            sprintf(errStr,"Unexpected function code in response [%d, %d expected]",buf[7],req.query[0]);
+            modbusErr = errStr;
+          }
+
+        } else if( frameLength<req.response_length+7 ) {
+
+          if( modbusErr.empty() ) {
+            char errStr[256];
+            sprintf(errStr,"Unexpected response length [%d bytes, %d expected]",frameLength,req.response_length+7);
+            modbusErr = errStr;
+          }
+
+        } else {
+
+          memcpy(req.response,buf+7,req.response_length);
+          req.done = true;
+
+        }
+
+      }
+
+      memmove(buf,buf+frameLength,bufLength-frameLength);
+      bufLength -= frameLength;
+
+    }
+
+  }
+
+  if( !modbusErr.empty() ) {
+    Tango::Except::throw_exception(
+      (const char *)"ModbusTCP::error_read",
+      (const char *)modbusErr.c_str(),
+      (const char *)"ModbusTCP::SendGetPipelined");
+  }
+
+}
+
+// -------------------------------------------------------
+
+short ModbusTCP::SendGetCounted (unsigned char *query, 
+	                 short query_length,
+	                 unsigned char *response, 
+	                 short max_length) {
+
+  unsigned char frame[MAX_FRAME_SIZE];
+
+  unsigned short tid = SendFrame(query,query_length);
+
+  int nbRead = ReadAnswer(tid,frame);
+
+  if( nbRead==0 ) {
+    // Connection 'gracefully' closed by peer !
+    // Retry
+    Disconnect(sock_);
+    tid = SendFrame(query,query_length);
+    nbRead = ReadAnswer(tid,frame);
+  }
+
+  if( nbRead < 0 ) {
+      // Transmission error, we need to reconnect
+      Disconnect(sock_);
+      Tango::Except::throw_exception(
+        (const char *)"ModbusTCP::error_read",
+        (const char *)lastError.c_str(),
+        (const char *)"ModbusTCP::SendGetCounted");
+  }
+
+  if( nbRead < 9 ) {
+    char errStr[256];
+    sprintf(errStr,"Unexpected response length [%d bytes]",nbRead);
+    Tango::Except::throw_exception(
+      (const char *)"ModbusTCP::error_read",
+      (const char *)errStr,
+      (const char *)"ModbusTCP::SendGetCounted");
+  }
+
+  if (frame[7] & 0x80) {
+
+    // We got a modbus error
+
+    short errCode = frame[8];
+    char errStr[256];
+    if( errCode<=0 || errCode>=nbError ) {
+      sprintf(errStr,"Unknow modbus error code [%d]",errCode);
+    } else {
+      strcpy(errStr,modbusError[errCode]);
+    }
+
+    Tango::Except::throw_exception(
+      (const char *)"ModbusTCP::error_read",
+      (const char *)errStr,
+      (const char *)"ModbusTCP::SendGetCounted");	      
+  
+  }
+
+  int response_length = ((nbRead >= 10) ? ((frame[8] << 8) + frame[9]) : 0) + 3;
+
+  if( nbRead<response_length+7 || response_length>max_length ) {
+    char errStr[256];
+    sprintf(errStr,"Unexpected response length [%d bytes, %d expected]",nbRead,response_length+7);
+    Tango::Except::throw_exception(
+      (const char *)"ModbusTCP::error_read",
+      (const char *)errStr,
+      (const char *)"ModbusTCP::SendGetCounted");
+  }
+
+  for (size_t i=0; i<(size_t)response_length; i++)
+    response[i] = frame[i+7];
+
+  return response_length;
+
+}
+
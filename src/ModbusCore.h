@@ -40,6 +40,15 @@
 // A modbus response frame is limited to 250 bytes.
 // Limiting the number of registers to be read at 120 per call seems OK.
 #define MAX_NB_REG 120
+// A read coils/inputs response carries at most 2000 bits (250 bytes).
+#define MAX_NB_COIL 2000
+// A write request frame carries at most 246 data bytes.
+#define MAX_NB_WRITE_REG 123
+#define MAX_NB_WRITE_COIL 1968
+// File record (FC20/FC21) request and response data are limited to 245 bytes.
+#define MAX_FILE_RECORD_BYTES 245
+// A FIFO queue (FC24) answer carries at most 31 registers.
+#define MAX_FIFO_COUNT 31
 #define MAX_FRAME_SIZE 512
 
 // MODBUS command code
@@ -62,6 +71,19 @@
 #define READ_WRITE_REGISTERS                    23
 #define READ_FIFO_QUEUE                         24
 
+// -----------------------------------------------------------------
+// One request of a multi-request (pipelined) exchange
+// -----------------------------------------------------------------
+
+struct ModbusRequest {
+  unsigned char query[MAX_FRAME_SIZE];     // PDU (function code + data)
+  short query_length;
+  unsigned char response[MAX_FRAME_SIZE];  // PDU of the answer
+  short response_length;                   // Expected answer length
+  bool done;                               // Answer received
+  bool sent;                               // Written to the link (maybe done by the device)
+};
+
 // -----------------------------------------------------------------
 // Abstract Modbus class
 // -----------------------------------------------------------------
@@ -87,6 +109,18 @@ public:
    virtual void Send ( unsigned char *query, 
   	               short query_length) = 0;
 
+   // Send several queries and wait for the answers. Requests already
+   // done are skipped. The default implementation sends them one by one.
+   virtual void SendGetPipelined (vector<ModbusRequest> &requests);
+
+   // Send a query whose answer length is given by the 2 bytes byte count
+   // following the function code (Read FIFO queue). The answer must not
+   // exceed max_length. Return the answer length.
+   virtual short SendGetCounted (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short max_length) = 0;
+
 };
 
 // -----------------------------------------------------------------
@@ -117,6 +151,12 @@ public:
    void Send ( unsigned char *query, 
   	       short query_length);
 
+   // Send a query with a variable length answer
+   short SendGetCounted (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short max_length);
+
 private:
    
   Tango::DeviceProxy *serialDS;
@@ -128,7 +168,8 @@ private:
   void SendGetInternal (unsigned char *query, 
 	         short query_length, 
 	         unsigned char *response, 
-	         short response_length);
+	         short response_length,
+	         short *counted_length = NULL);
 
   // Log error   
   void LogError(const char *msg,unsigned char *inFrame,short inFrameLgth,unsigned char *outFrame,short outFrameLgth);
@@ -149,7 +190,7 @@ class ModbusTCP: public ModbusCore {
 public:
 
    // Construct a ModbusCore TCP object
-   ModbusTCP(std::string ipHost, short port, short node, double tcpTimeout, double connectTimeout, bool tcpNoDelay, bool tcpQuickAck, bool tcpKeepAlive);
+   ModbusTCP(std::string ipHost, short port, short node, double tcpTimeout, double connectTimeout, bool tcpNoDelay, bool tcpQuickAck, bool tcpKeepAlive, short pipelineDepth);
    ~ModbusTCP();
 
    // Return state
@@ -168,6 +209,15 @@ public:
    void Send ( unsigned char *query, 
   	       short query_length);
 
+   // Send a query with a variable length answer
+   short SendGetCounted (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short max_length);
+
+   // Send several queries, keeping up to pipelineDepth of them in flight
+   void SendGetPipelined (vector<ModbusRequest> &requests);
+
 private:
    
   short node;
@@ -185,12 +235,16 @@ private:
   char *hostInfo;
   int   hostInfoLength;
   int   hostAddrType;
+  short pipelineDepth;
+  unsigned short transactionId;
   
 
   // Timeout parameters are in millisecond
   bool IsConnected();
   void Disconnect(int& sock);
   bool Connect(int *retSock);
+  unsigned short SendFrame(unsigned char *query, short query_length);
+  int ReadAnswer(unsigned short tid, unsigned char *frame);
   int Write(int sock, char *buf, int bufsize,int timeout);
   int Read(int sock, char *buf, int bufsize,int timeout);
   int WaitFor(int sock,int timeout,int mode);
@@ -50,6 +50,21 @@ namespace Modbus_ns
 //		Attributes Allowed Methods
 //=================================================
 
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_CacheBlock_allowed()
+ *	Description : Execution allowed for CacheBlock attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_CacheBlock_allowed(TANGO_UNUSED(Tango::AttReqType type))
+{
+	//	Not any excluded states for CacheBlock attribute in read access.
+	/*----- PROTECTED REGION ID(Modbus::CacheBlockStateAllowed_READ) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::CacheBlockStateAllowed_READ
+	return true;
+}
+
 
 //=================================================
 //		Commands Allowed Methods
@@ -265,6 +280,216 @@ bool Modbus::is_ReadExceptionStatus_allowed(TANGO_UNUSED(const CORBA::Any &any))
 	return true;
 }
 
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadBlocks_allowed()
+ *	Description : Execution allowed for ReadBlocks attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadBlocks_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadBlocks command.
+	/*----- PROTECTED REGION ID(Modbus::ReadBlocksStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadBlocksStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadScattered_allowed()
+ *	Description : Execution allowed for ReadScattered attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadScattered_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadScattered command.
+	/*----- PROTECTED REGION ID(Modbus::ReadScatteredStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadScatteredStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_AsyncWriteStatus_allowed()
+ *	Description : Execution allowed for AsyncWriteStatus attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_AsyncWriteStatus_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for AsyncWriteStatus command.
+	/*----- PROTECTED REGION ID(Modbus::AsyncWriteStatusStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::AsyncWriteStatusStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadFileRecord_allowed()
+ *	Description : Execution allowed for ReadFileRecord attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadFileRecord_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadFileRecord command.
+	/*----- PROTECTED REGION ID(Modbus::ReadFileRecordStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadFileRecordStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_WriteFileRecord_allowed()
+ *	Description : Execution allowed for WriteFileRecord attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_WriteFileRecord_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for WriteFileRecord command.
+	/*----- PROTECTED REGION ID(Modbus::WriteFileRecordStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::WriteFileRecordStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadFifoQueue_allowed()
+ *	Description : Execution allowed for ReadFifoQueue attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadFifoQueue_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadFifoQueue command.
+	/*----- PROTECTED REGION ID(Modbus::ReadFifoQueueStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadFifoQueueStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadFifoQueueTimed_allowed()
+ *	Description : Execution allowed for ReadFifoQueueTimed attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadFifoQueueTimed_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadFifoQueueTimed command.
+	/*----- PROTECTED REGION ID(Modbus::ReadFifoQueueTimedStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadFifoQueueTimedStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_SchedulerStatistics_allowed()
+ *	Description : Execution allowed for SchedulerStatistics attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_SchedulerStatistics_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for SchedulerStatistics command.
+	/*----- PROTECTED REGION ID(Modbus::SchedulerStatisticsStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::SchedulerStatisticsStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_CacheStatistics_allowed()
+ *	Description : Execution allowed for CacheStatistics attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_CacheStatistics_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for CacheStatistics command.
+	/*----- PROTECTED REGION ID(Modbus::CacheStatisticsStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::CacheStatisticsStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_CachePlan_allowed()
+ *	Description : Execution allowed for CachePlan attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_CachePlan_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for CachePlan command.
+	/*----- PROTECTED REGION ID(Modbus::CachePlanStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::CachePlanStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadMaxAge_allowed()
+ *	Description : Execution allowed for ReadMaxAge attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadMaxAge_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadMaxAge command.
+	/*----- PROTECTED REGION ID(Modbus::ReadMaxAgeStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadMaxAgeStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadCacheStatistics_allowed()
+ *	Description : Execution allowed for ReadCacheStatistics attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadCacheStatistics_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadCacheStatistics command.
+	/*----- PROTECTED REGION ID(Modbus::ReadCacheStatisticsStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadCacheStatisticsStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadHistory_allowed()
+ *	Description : Execution allowed for ReadHistory attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadHistory_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadHistory command.
+	/*----- PROTECTED REGION ID(Modbus::ReadHistoryStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadHistoryStateAllowed
+	return true;
+}
+
+//--------------------------------------------------------
+/**
+ *	Method      : Modbus::is_ReadFifoQueueSince_allowed()
+ *	Description : Execution allowed for ReadFifoQueueSince attribute
+ */
+//--------------------------------------------------------
+bool Modbus::is_ReadFifoQueueSince_allowed(TANGO_UNUSED(const CORBA::Any &any))
+{
+	//	Not any excluded states for ReadFifoQueueSince command.
+	/*----- PROTECTED REGION ID(Modbus::ReadFifoQueueSinceStateAllowed) ENABLED START -----*/
+	
+	/*----- PROTECTED REGION END -----*/	//	Modbus::ReadFifoQueueSinceStateAllowed
+	return true;
+}
+
 
 /*----- PROTECTED REGION ID(Modbus::ModbusStateAllowed.AdditionalMethods) ENABLED START -----*/
 
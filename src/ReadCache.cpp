@@ -0,0 +1,194 @@
+//=============================================================================
+//
+// file :        ReadCache.cpp
+//
+// description : Read-through cache of the uncached ranges
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <ReadCache.h>
+#include <CacheThread.h>
+#include <limits.h>
+
+namespace Modbus_ns
+{
+
+//+======================================================================
+// Method:    ReadCache::ReadCache()
+//
+// Arg(s) In: - size : Max number of cached ranges
+//			  - ttl_ms : Time a range is served after its read (ms)
+//-=====================================================================
+
+ReadCache::ReadCache(long size,long ttl_ms):max_entries(size),generation(0)
+{
+	ttl_us = (long long)ttl_ms * 1000;
+	memset(&stats,0,sizeof(stats));
+}
+
+//+======================================================================
+// Method:    ReadCache::get()
+//
+// Description:	Look for the range. A hit moves it to the front of the
+//				LRU list, an expired range is dropped.
+//-=====================================================================
+
+bool ReadCache::get(unsigned char fc,long adr,long nb,vector<short> &data,unsigned long &gen)
+{
+	Key k;
+	k.fc = fc;
+	k.adr = adr;
+	k.nb = nb;
+
+	omni_mutex_lock sync(mutex);
+	gen = generation;
+	map<Key,EntryIt>::iterator it = entries.find(k);
+	if (it == entries.end())
+	{
+		stats.nb_misses++;
+		return false;
+	}
+
+	if (cache_clock_us() - it->second->date_us > ttl_us)
+	{
+		erase(it);
+		stats.nb_misses++;
+		stats.nb_expired++;
+		return false;
+	}
+
+	lru.splice(lru.begin(),lru,it->second);
+	data = it->second->data;
+	stats.nb_hits++;
+	return true;
+}
+
+//+======================================================================
+// Method:    ReadCache::put()
+//
+// Description:	Store (or refresh) a range, dropping the least recently
+//				used one when the cache is full. The range is not
+//				stored when a write overlapping it was invalidated
+//				after generation gen (the read started before), or
+//				when too many invalidations happened to know.
+//-=====================================================================
+
+void ReadCache::put(unsigned char fc,long adr,long nb,const short *data,unsigned long gen)
+{
+	Key k;
+	k.fc = fc;
+	k.adr = adr;
+	k.nb = nb;
+
+	omni_mutex_lock sync(mutex);
+	if (generation - gen >= READ_CACHE_LOG_SIZE)
+		return;
+	for (unsigned long g = gen + 1;g <= generation;g++)
+	{
+		Invalidation &inv = log[g % READ_CACHE_LOG_SIZE];
+		if ((inv.fc == fc) && (inv.adr < adr + nb) && (inv.adr + inv.nb > adr))
+			return;
+	}
+	map<Key,EntryIt>::iterator it = entries.find(k);
+	if (it != entries.end())
+		lru.splice(lru.begin(),lru,it->second);
+	else
+	{
+		if ((long)entries.size() >= max_entries)
+		{
+			erase(entries.find(lru.back().key));
+			stats.nb_evicted++;
+		}
+		lru.push_front(Entry());
+		lru.front().key = k;
+		it = entries.insert(make_pair(k,lru.begin())).first;
+	}
+
+	Entry &e = *(it->second);
+	e.date_us = cache_clock_us();
+	e.data.assign(data,data + nb);
+	stats.nb_entries = entries.size();
+}
+
+//+======================================================================
+// Method:    ReadCache::invalidate()
+//
+// Description:	Drop the ranges overlapping a written range. The map is
+//				sorted on the first address, the scan stops at the first
+//				range starting after the written one. The written range
+//				is logged for the reads in progress (see put()).
+//-=====================================================================
+
+void ReadCache::invalidate(unsigned char fc,long adr,long nb)
+{
+	Key k;
+	k.fc = fc;
+	k.adr = LONG_MIN;
+	k.nb = 0;
+
+	omni_mutex_lock sync(mutex);
+	generation++;
+	Invalidation &inv = log[generation % READ_CACHE_LOG_SIZE];
+	inv.fc = fc;
+	inv.adr = adr;
+	inv.nb = nb;
+	map<Key,EntryIt>::iterator it = entries.lower_bound(k);
+	while ((it != entries.end()) && (it->first.fc == fc) && (it->first.adr < adr + nb))
+	{
+		map<Key,EntryIt>::iterator cur = it++;
+		if (cur->first.adr + cur->first.nb > adr)
+		{
+			erase(cur);
+			stats.nb_invalidated++;
+		}
+	}
+}
+
+//+======================================================================
+// Method:    ReadCache::get_statistics()
+//-=====================================================================
+
+void ReadCache::get_statistics(ReadCacheStatistics &st)
+{
+	omni_mutex_lock sync(mutex);
+	st = stats;
+}
+
+//+======================================================================
+// Method:    ReadCache::erase()
+//
+// Description:	Remove one range (mutex already taken)
+//-=====================================================================
+
+void ReadCache::erase(map<Key,EntryIt>::iterator it)
+{
+	lru.erase(it->second);
+	entries.erase(it);
+	stats.nb_entries = entries.size();
+}
+
+} // End of namespace
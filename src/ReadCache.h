@@ -0,0 +1,130 @@
+//+*********************************************************************
+//
+// File:        ReadCache.h
+//
+// Project:     Modbus
+//
+// Description: Read-through cache of the uncached ranges
+//
+// This file is part of Tango device class.
+// 
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+
+#ifndef _ReadCache_H
+#define _ReadCache_H
+
+#include <tango.h>
+#include <list>
+
+namespace Modbus_ns
+{
+
+//+=====================================================================
+// Read-through cache. The ranges read by the clients and not covered
+// by CacheConfig are kept here for a limited time (TTL). The least
+// recently used range is dropped when the cache is full. A range is
+// only served for the same (function code, address, count) request.
+// A read started before a write must not store the value it got:
+// get() returns the invalidation generation, put() rejects the range
+// when an overlapping write was invalidated since.
+//-=====================================================================
+
+// Number of invalidations remembered for put()
+#define READ_CACHE_LOG_SIZE		64
+
+struct ReadCacheStatistics
+{
+	unsigned long		nb_hits;
+	unsigned long		nb_misses;
+	unsigned long		nb_expired;		// Misses on a range older than the TTL
+	unsigned long		nb_evicted;		// Ranges dropped because the cache was full
+	unsigned long		nb_invalidated;	// Ranges dropped by a write
+	unsigned long		nb_entries;
+};
+
+class ReadCache
+{
+public:
+	ReadCache(long size,long ttl_ms);
+
+	// Return true and the data when the range is cached and not expired.
+	// gen is the current invalidation generation, to give to put().
+	bool get(unsigned char fc,long adr,long nb,vector<short> &data,unsigned long &gen);
+
+	// Store a range read from the device, unless a write overlapping it
+	// was invalidated after generation gen
+	void put(unsigned char fc,long adr,long nb,const short *data,unsigned long gen);
+
+	// Drop the ranges of this function code overlapping adr..adr+nb-1
+	void invalidate(unsigned char fc,long adr,long nb);
+
+	void get_statistics(ReadCacheStatistics &);
+
+protected:
+	struct Key
+	{
+		unsigned char	fc;
+		long			adr;
+		long			nb;
+		bool operator<(const Key &k) const
+		{
+			if (fc != k.fc)
+				return fc < k.fc;
+			if (adr != k.adr)
+				return adr < k.adr;
+			return nb < k.nb;
+		}
+	};
+
+	struct Entry
+	{
+		Key				key;
+		long long		date_us;
+		vector<short>	data;
+	};
+
+	typedef list<Entry>::iterator EntryIt;
+
+	struct Invalidation
+	{
+		unsigned char	fc;
+		long			adr;
+		long			nb;
+	};
+
+	omni_mutex				mutex;
+	long					max_entries;
+	long long				ttl_us;
+	list<Entry>				lru;		// Most recently used first
+	map<Key,EntryIt>		entries;	// Sorted on function code and address
+	ReadCacheStatistics		stats;
+	unsigned long			generation;	// Number of invalidations
+	Invalidation			log[READ_CACHE_LOG_SIZE];	// The last ones, by generation
+
+	void erase(map<Key,EntryIt>::iterator);
+};
+
+} // End of namespace
+
+#endif /* _ReadCache_H */
@@ -0,0 +1,222 @@
+//=============================================================================
+//
+// file :        ReadPlanner.cpp
+//
+// description : Link cost model and scattered read planner
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <ReadPlanner.h>
+#include <CacheThread.h>
+#include <math.h>
+
+namespace Modbus_ns
+{
+
+// Weight of the past exchanges (about the last 100 ones are significant)
+#define LINK_STATS_DECAY		0.99
+// Number of exchanges before trusting the fit
+#define LINK_STATS_MIN_SAMPLES	8
+// Default guess (see set_default): 5 ms turn around on a 115200 bauds
+// serial line
+#define DEFAULT_LATENCY			0.005
+#define DEFAULT_SEC_PER_BYTE	(10.0 / 115200.0)
+
+// Bytes of a read query PDU and of the response PDU header
+#define READ_QUERY_BYTES		5
+#define READ_RESPONSE_BYTES		2
+
+//+======================================================================
+// Method:    LinkStats::LinkStats()
+//-=====================================================================
+
+LinkStats::LinkStats():nb_samples(0),default_latency(DEFAULT_LATENCY),
+					  default_sec_per_byte(DEFAULT_SEC_PER_BYTE),
+					  sw(0.0),sx(0.0),sy(0.0),sxx(0.0),sxy(0.0)
+{
+}
+
+//+======================================================================
+// Method:    LinkStats::add()
+//
+// Description:	Record one measured exchange
+//
+// Arg(s) In: - nb_bytes : Query and response PDU bytes
+//			  - duration : Exchange duration (sec)
+//-=====================================================================
+
+void LinkStats::add(long nb_bytes,double duration)
+{
+	double x = (double)nb_bytes;
+
+	omni_mutex_lock sync(mutex);
+	sw  = sw  * LINK_STATS_DECAY + 1.0;
+	sx  = sx  * LINK_STATS_DECAY + x;
+	sy  = sy  * LINK_STATS_DECAY + duration;
+	sxx = sxx * LINK_STATS_DECAY + x * x;
+	sxy = sxy * LINK_STATS_DECAY + x * duration;
+	nb_samples++;
+}
+
+//+======================================================================
+// Method:    LinkStats::get()
+//
+// Description:	Return the current latency and transfer time per byte.
+//				When all the exchanges have the same size, only the
+//				latency can be fitted and the default byte rate is kept.
+//-=====================================================================
+
+void LinkStats::get(double &latency,double &sec_per_byte)
+{
+	omni_mutex_lock sync(mutex);
+	latency = default_latency;
+	sec_per_byte = default_sec_per_byte;
+
+	if (nb_samples < LINK_STATS_MIN_SAMPLES)
+		return;
+
+	double mx = sx / sw;
+	double my = sy / sw;
+	double vx = sxx / sw - mx * mx;
+
+	if (vx > 1.0)
+	{
+		double slope = (sxy / sw - mx * my) / vx;
+		if (slope > 0.0)
+			sec_per_byte = slope;
+	}
+
+	latency = my - sec_per_byte * mx;
+	if (latency < 0.0)
+		latency = 0.0;
+}
+
+//+======================================================================
+// Method:    LinkStats::set_default()
+//
+// Description:	Set the estimations used before LINK_STATS_MIN_SAMPLES
+//				exchanges are recorded (and the byte rate kept when
+//				all the exchanges have the same size)
+//-=====================================================================
+
+void LinkStats::set_default(double latency,double sec_per_byte)
+{
+	omni_mutex_lock sync(mutex);
+	default_latency = latency;
+	default_sec_per_byte = sec_per_byte;
+}
+
+//+======================================================================
+// Method:    LinkStats::is_fitted()
+//-=====================================================================
+
+bool LinkStats::is_fitted()
+{
+	omni_mutex_lock sync(mutex);
+	return nb_samples >= LINK_STATS_MIN_SAMPLES;
+}
+
+//+======================================================================
+// Method:    LinkStats::get_nb_samples()
+//-=====================================================================
+
+unsigned long LinkStats::get_nb_samples()
+{
+	omni_mutex_lock sync(mutex);
+	return nb_samples;
+}
+
+//+======================================================================
+// Method:    LinkStats::now()
+//-=====================================================================
+
+double LinkStats::now()
+{
+	return (double)cache_clock_us() / 1000000.0;
+}
+
+//+======================================================================
+// Method:    plan_reads()
+//
+// Description:	Dynamic programming on the sorted address list.
+//				best[i] is the minimum time to read the i first
+//				addresses, the last frame covering addresses j..i-1.
+//				With pipelined frames, pipeline_depth turn arounds
+//				overlap: each frame only adds a part of the latency,
+//				the bytes still follow each other on the link.
+//
+// Arg(s) In: - addresses : Sorted list of unique addresses
+//			  - max_per_frame : Max number of items in one frame
+//			  - bytes_per_item : 2 for registers, 1/8 for coils
+//			  - latency, sec_per_byte : Link cost model
+//			  - pipeline_depth : Max frames in flight (1: no pipeline)
+//
+// Arg(s) Out: - frames : Frames to read, in address order
+//-=====================================================================
+
+void plan_reads(const vector<long> &addresses,long max_per_frame,double bytes_per_item,
+				double latency,double sec_per_byte,long pipeline_depth,vector<ReadFrame> &frames)
+{
+	long nb = addresses.size();
+	double frame_latency = latency / ((pipeline_depth > 1) ? pipeline_depth : 1);
+	vector<double> best(nb + 1,0.0);
+	vector<long> first(nb + 1,0);
+
+	frames.clear();
+	if (nb == 0)
+		return;
+
+	for (long i = 1;i <= nb;i++)
+	{
+		best[i] = -1.0;
+		for (long j = i - 1;j >= 0;j--)
+		{
+			long span = addresses[i - 1] - addresses[j] + 1;
+			if (span > max_per_frame)
+				break;
+
+			double bytes = READ_QUERY_BYTES + READ_RESPONSE_BYTES + ceil(span * bytes_per_item);
+			double cost = best[j] + frame_latency + bytes * sec_per_byte;
+			if ((best[i] < 0.0) || (cost < best[i]))
+			{
+				best[i] = cost;
+				first[i] = j;
+			}
+		}
+	}
+
+	// Walk back the chosen frames
+	for (long i = nb;i > 0;i = first[i])
+	{
+		ReadFrame rf;
+		rf.address = addresses[first[i]];
+		rf.count = addresses[i - 1] - addresses[first[i]] + 1;
+		frames.insert(frames.begin(),rf);
+	}
+}
+
+} // End of namespace
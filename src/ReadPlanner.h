@@ -0,0 +1,101 @@
+//+*********************************************************************
+//
+// File:        ReadPlanner.h
+//
+// Project:     Modbus
+//
+// Description: Link cost model and scattered read planner
+//
+// This file is part of Tango device class.
+// 
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+// 
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#ifndef _ReadPlanner_H
+#define _ReadPlanner_H
+
+#include <tango.h>
+
+namespace Modbus_ns
+{
+
+//+=====================================================================
+// Link cost model. The time of one exchange is modelled as
+//	latency + nb_bytes / byte_rate
+// and both terms are fitted (weighted least squares with exponential
+// forgetting) on the measured exchanges of the device.
+//-=====================================================================
+
+class LinkStats
+{
+public:
+	LinkStats();
+
+	// Record one exchange (query + response PDU bytes, duration in sec)
+	void add(long nb_bytes,double duration);
+
+	// Current estimations (sec and sec per byte)
+	void get(double &latency,double &sec_per_byte);
+
+	// Estimations returned until enough exchanges are recorded
+	void set_default(double latency,double sec_per_byte);
+
+	// True once the estimations come from the recorded exchanges
+	bool is_fitted();
+
+	// Number of recorded exchanges
+	unsigned long get_nb_samples();
+
+	// Monotonic time in sec, to measure exchanges
+	static double now();
+
+protected:
+	omni_mutex		mutex;
+	unsigned long	nb_samples;
+	double			default_latency;
+	double			default_sec_per_byte;
+	double			sw;
+	double			sx;
+	double			sy;
+	double			sxx;
+	double			sxy;
+};
+
+//+=====================================================================
+// Scattered read planner
+//-=====================================================================
+
+struct ReadFrame
+{
+	long	address;
+	long	count;
+};
+
+// Choose the contiguous frames covering the sorted (unique) address list
+// which minimise the expected read time. Items between two requested
+// addresses are read only when it is cheaper than another request.
+void plan_reads(const vector<long> &addresses,long max_per_frame,double bytes_per_item,
+				double latency,double sec_per_byte,long pipeline_depth,vector<ReadFrame> &frames);
+
+} // End of namespace
+
+#endif /* _ReadPlanner_H */
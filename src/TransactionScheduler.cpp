@@ -0,0 +1,583 @@
+//=============================================================================
+//
+// file :        TransactionScheduler.cpp
+//
+// description : Transaction scheduler owning the Modbus transport
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+#include <TransactionScheduler.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+// ---------------------------------------------------------------------
+// Atomic operations used by the queue
+// ---------------------------------------------------------------------
+
+#ifdef WIN32
+
+template <class T> static inline T *atomic_exchange(T * volatile *p,T *v) {
+  return (T *)InterlockedExchangePointer((PVOID volatile *)p,(PVOID)v);
+}
+template <class T> static inline void atomic_store(T * volatile *p,T *v) {
+  InterlockedExchangePointer((PVOID volatile *)p,(PVOID)v);
+}
+template <class T> static inline T *atomic_load(T * volatile *p) {
+  T *v = *p;
+  MemoryBarrier();
+  return v;
+}
+static inline long atomic_add(volatile long *p,long v) {
+  return InterlockedExchangeAdd(p,v) + v;
+}
+static inline void full_barrier() {
+  MemoryBarrier();
+}
+
+#else
+
+template <class T> static inline T *atomic_exchange(T * volatile *p,T *v) {
+  return __atomic_exchange_n(p,v,__ATOMIC_ACQ_REL);
+}
+template <class T> static inline void atomic_store(T * volatile *p,T *v) {
+  __atomic_store_n(p,v,__ATOMIC_RELEASE);
+}
+template <class T> static inline T *atomic_load(T * volatile *p) {
+  return __atomic_load_n(p,__ATOMIC_ACQUIRE);
+}
+static inline long atomic_add(volatile long *p,long v) {
+  return __atomic_add_fetch(p,v,__ATOMIC_ACQ_REL);
+}
+static inline void full_barrier() {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+// -------------------------------------------------------
+
+TransactionScheduler::TransactionScheduler(ModbusCore *core,
+                                           ModbusCore *controlCore,
+                                           const vector<long> &weights) {
+
+  this->core = core;
+  this->controlCore = controlCore;
+  isBackgroundThread = NULL;
+  queueDepth = 0;
+  stopping = false;
+  submitting = 0;
+
+  weighted = (weights.size()==NB_LANES);
+  for(int l=0;l<NB_LANES;l++) {
+    queues[l].stub.next = NULL;
+    queues[l].head = &queues[l].stub;
+    queues[l].tail = &queues[l].stub;
+    this->weights[l] = weighted ? weights[l] : 1;
+  }
+
+  memset(&stats,0,sizeof(stats));
+  sumWait = 0.0;
+  sumService = 0.0;
+  for(int l=0;l<NB_LANES;l++)
+    sumLaneWait[l] = 0.0;
+
+  if( controlCore ) {
+    dispatchers.push_back(new Dispatcher(this,controlCore,CONTROL_LANE,CONTROL_LANE));
+    dispatchers.push_back(new Dispatcher(this,core,INTERACTIVE_LANE,BACKGROUND_LANE));
+  } else {
+    dispatchers.push_back(new Dispatcher(this,core,CONTROL_LANE,BACKGROUND_LANE));
+  }
+
+  for(size_t i=0;i<dispatchers.size();i++) {
+    Dispatcher *d = dispatchers[i];
+    for(int l=d->firstLane;l<=d->lastLane;l++) {
+      laneOwner[l] = d;
+      d->credits[l] = this->weights[l];
+    }
+    d->start();
+  }
+
+}
+
+// -------------------------------------------------------
+
+TransactionScheduler::~TransactionScheduler() {
+
+  // New transactions are refused. The ones which passed the check
+  // are pushed before the exit requests. The exit requests may be
+  // served before the pending transactions (other lane), the
+  // dispatchers cancel the ones left before exiting.
+  stopping = true;
+  full_barrier();
+  while( submitting!=0 )
+    omni_thread::yield();
+
+  vector<Transaction> exits(dispatchers.size());
+  for(size_t i=0;i<dispatchers.size();i++) {
+    exits[i].type = EXIT;
+    exits[i].lane = dispatchers[i]->lastLane;
+    exits[i].done = NULL;
+    Push(&exits[i]);
+  }
+
+  for(size_t i=0;i<dispatchers.size();i++) {
+    void *ptr = 0;
+    dispatchers[i]->join(&ptr);
+  }
+
+  delete core;
+  if( controlCore )
+    delete controlCore;
+
+}
+
+// -------------------------------------------------------
+
+Tango::DevState TransactionScheduler::State() {
+  return core->State();
+}
+
+// -------------------------------------------------------
+
+string TransactionScheduler::Status() {
+  return core->Status();
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::SendGet (unsigned char *query,
+	                 short query_length,
+	                 unsigned char *response,
+	                 short response_length) {
+
+  SendGet(query,query_length,response,response_length,NULL);
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::SendGet (unsigned char *query,
+	                 short query_length,
+	                 unsigned char *response,
+	                 short response_length,
+	                 double *service) {
+
+  Transaction t;
+  t.type = SEND_GET;
+  t.query = query;
+  t.query_length = query_length;
+  t.response = response;
+  t.response_length = response_length;
+  Submit(t,query[0]);
+  if( service ) *service = t.service;
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::Send ( unsigned char *query,
+  	               short query_length) {
+
+  Transaction t;
+  t.type = SEND;
+  t.query = query;
+  t.query_length = query_length;
+  Submit(t,query[0]);
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::SendGetPipelined (vector<ModbusRequest> &requests) {
+
+  if( requests.empty() )
+    return;
+
+  Transaction t;
+  t.type = SEND_GET_PIPELINED;
+  t.requests = &requests;
+  Submit(t,requests[0].query[0]);
+
+}
+
+// -------------------------------------------------------
+
+short TransactionScheduler::SendGetCounted (unsigned char *query,
+	                 short query_length,
+	                 unsigned char *response,
+	                 short max_length) {
+
+  Transaction t;
+  t.type = SEND_GET_COUNTED;
+  t.query = query;
+  t.query_length = query_length;
+  t.response = response;
+  t.response_length = max_length;
+  Submit(t,query[0]);
+  return t.result;
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::SetBackgroundThreads(bool (*isBackground)(int id)) {
+  isBackgroundThread = isBackground;
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::GetStatistics(SchedulerStatistics &s) {
+
+  omni_mutex_lock sync(statsMutex);
+  s = stats;
+  s.queue_depth = atomic_add(&queueDepth,0);
+  if( stats.nb_transactions>0 ) {
+    s.mean_wait = sumWait / stats.nb_transactions;
+    s.mean_service = sumService / stats.nb_transactions;
+  }
+  for(int l=0;l<NB_LANES;l++)
+    if( stats.lanes[l].nb_transactions>0 )
+      s.lanes[l].mean_wait = sumLaneWait[l] / stats.lanes[l].nb_transactions;
+
+}
+
+// -------------------------------------------------------
+// Writes are control actions, the cache polling threads run
+// in background and anything else is a client read.
+
+int TransactionScheduler::GetLane(unsigned char functionCode) {
+
+  switch( functionCode ) {
+    case FORCE_SINGLE_COIL:
+    case PRESET_SINGLE_REGISTER:
+    case FORCE_MULTIPLE_COILS:
+    case PRESET_MULTIPLE_REGISTERS:
+    case WRITE_GENERAL_REFERENCE:
+    case MASK_WRITE_REGISTER:
+    case READ_WRITE_REGISTERS:
+      return CONTROL_LANE;
+  }
+
+  omni_thread *th = omni_thread::self();
+  if( th!=NULL && isBackgroundThread!=NULL && isBackgroundThread(th->id()) )
+    return BACKGROUND_LANE;
+
+  return INTERACTIVE_LANE;
+
+}
+
+// -------------------------------------------------------
+// Queue the transaction and wait for its execution
+
+void TransactionScheduler::Submit(Transaction &t,unsigned char functionCode) {
+
+  omni_semaphore done(0);
+  t.failed = false;
+  t.result = 0;
+  t.service = 0.0;
+  t.lane = GetLane(functionCode);
+  t.done = &done;
+  t.submit_date = Now();
+
+  // The destructor waits for the submits which saw stopping false
+  atomic_add(&submitting,1);
+  full_barrier();
+  if( stopping ) {
+    atomic_add(&submitting,-1);
+    Tango::Except::throw_exception(
+      (const char *)"TransactionScheduler::error_stopped",
+      (const char *)"The connection is being closed",
+      (const char *)"TransactionScheduler::Submit");
+  }
+
+  long depth = atomic_add(&queueDepth,1);
+  if( depth>stats.max_queue_depth ) {
+    omni_mutex_lock sync(statsMutex);
+    if( depth>stats.max_queue_depth )
+      stats.max_queue_depth = depth;
+  }
+
+  Push(&t);
+  atomic_add(&submitting,-1);
+  done.wait();
+
+  if( t.failed )
+    throw t.error;
+
+}
+
+// -------------------------------------------------------
+// Producers: one atomic exchange, then link the previous node
+
+void TransactionScheduler::Push(Transaction *t) {
+
+  Queue &q = queues[t->lane];
+  t->next = NULL;
+  Transaction *prev = atomic_exchange(&q.head,t);
+  atomic_store(&prev->next,t);
+  laneOwner[t->lane]->wakeup.post();
+
+}
+
+// -------------------------------------------------------
+// Consumer (dispatcher thread only). Return NULL when the
+// queue is empty or when a producer is between its exchange
+// and its link.
+
+TransactionScheduler::Transaction *TransactionScheduler::Pop(Queue &q) {
+
+  Transaction *t = q.tail;
+  Transaction *next = atomic_load(&t->next);
+
+  if( t==&q.stub ) {
+    if( next==NULL )
+      return NULL;
+    q.tail = next;
+    t = next;
+    next = atomic_load(&next->next);
+  }
+
+  if( next!=NULL ) {
+    q.tail = next;
+    return t;
+  }
+
+  if( t!=atomic_load(&q.head) )
+    return NULL;
+
+  // Last node: put the stub back behind it to detach it
+  q.stub.next = NULL;
+  Transaction *prev = atomic_exchange(&q.head,&q.stub);
+  atomic_store(&prev->next,&q.stub);
+
+  next = atomic_load(&t->next);
+  if( next!=NULL ) {
+    q.tail = next;
+    return t;
+  }
+  return NULL;
+
+}
+
+// -------------------------------------------------------
+// Consumer: first transaction of a queue, left in it. NULL
+// when empty or when the first push is not linked yet.
+
+TransactionScheduler::Transaction *TransactionScheduler::Peek(Queue &q) {
+
+  Transaction *t = q.tail;
+  if( t==&q.stub )
+    t = atomic_load(&t->next);
+  return t;
+
+}
+
+// -------------------------------------------------------
+// Pick the next transaction. Strict priority: the first
+// non empty lane, unless a lower lane waited more than
+// LANE_MAX_WAIT (the cache polling would time out behind
+// a flow of client requests). Weighted: a lane is served
+// at most weight times per round, a new round starts when
+// no lane having credits has a transaction.
+
+TransactionScheduler::Transaction *TransactionScheduler::Next(Dispatcher *d) {
+
+  if( !weighted ) {
+    double now = Now();
+    for(int l=d->lastLane;l>d->firstLane;l--) {
+      Transaction *t = Peek(queues[l]);
+      if( t!=NULL && now-t->submit_date>LANE_MAX_WAIT ) {
+        t = Pop(queues[l]);
+        if( t!=NULL )
+          return t;
+      }
+    }
+  }
+
+  for(int round=0;round<2;round++) {
+
+    for(int l=d->firstLane;l<=d->lastLane;l++) {
+      if( weighted && d->credits[l]<=0 )
+        continue;
+      Transaction *t = Pop(queues[l]);
+      if( t!=NULL ) {
+        if( weighted ) d->credits[l]--;
+        return t;
+      }
+    }
+
+    if( !weighted )
+      break;
+    for(int l=d->firstLane;l<=d->lastLane;l++)
+      d->credits[l] = weights[l];
+
+  }
+
+  return NULL;
+
+}
+
+// -------------------------------------------------------
+// Next transaction, once a wakeup token is taken. The push
+// which posted the token may not be linked yet: a few yields,
+// then short sleeps so that a preempted producer does not
+// keep the dispatcher spinning.
+
+TransactionScheduler::Transaction *TransactionScheduler::Take(Dispatcher *d) {
+
+  Transaction *t;
+  for(int spin=0;(t = Next(d))==NULL;spin++) {
+    if( spin<TAKE_SPIN )
+      omni_thread::yield();
+    else
+      omni_thread::sleep(0,TAKE_SLEEP_NS);
+  }
+  return t;
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::Dispatch(Dispatcher *d) {
+
+  while( true ) {
+
+    // One token per queued transaction
+    d->wakeup.wait();
+
+    Transaction *t = Take(d);
+
+    if( t->type==EXIT ) {
+      Cancel(d);
+      break;
+    }
+
+    double start = Now();
+    Execute(d->core,*t);
+    double end = Now();
+    t->service = end - start;
+
+    atomic_add(&queueDepth,-1);
+    {
+      omni_mutex_lock sync(statsMutex);
+      double wait = start - t->submit_date;
+      LaneStatistics &ls = stats.lanes[t->lane];
+      stats.nb_transactions++;
+      sumWait += wait;
+      sumService += t->service;
+      if( wait>stats.max_wait ) stats.max_wait = wait;
+      if( t->service>stats.max_service ) stats.max_service = t->service;
+      ls.nb_transactions++;
+      sumLaneWait[t->lane] += wait;
+      if( wait>ls.max_wait ) ls.max_wait = wait;
+    }
+
+    t->done->post();
+
+  }
+
+}
+
+// -------------------------------------------------------
+// Fail the transactions still queued on the dispatcher lanes
+// when it exits (one wakeup token per transaction)
+
+void TransactionScheduler::Cancel(Dispatcher *d) {
+
+  while( d->wakeup.trywait() ) {
+
+    Transaction *t = Take(d);
+
+    try {
+      Tango::Except::throw_exception(
+        (const char *)"TransactionScheduler::error_stopped",
+        (const char *)"The connection has been closed before the transaction",
+        (const char *)"TransactionScheduler::Cancel");
+    } catch(Tango::DevFailed &e) {
+      t->failed = true;
+      t->error = e;
+    }
+
+    atomic_add(&queueDepth,-1);
+    t->done->post();
+
+  }
+
+}
+
+// -------------------------------------------------------
+
+void TransactionScheduler::Execute(ModbusCore *c,Transaction &t) {
+
+  try {
+    switch( t.type ) {
+      case SEND_GET:
+        c->SendGet(t.query,t.query_length,t.response,t.response_length);
+        break;
+      case SEND:
+        c->Send(t.query,t.query_length);
+        break;
+      case SEND_GET_PIPELINED:
+        c->SendGetPipelined(*t.requests);
+        break;
+      case SEND_GET_COUNTED:
+        t.result = c->SendGetCounted(t.query,t.query_length,t.response,t.response_length);
+        break;
+      default:
+        break;
+    }
+  } catch(Tango::DevFailed &e) {
+    t.failed = true;
+    t.error = e;
+  }
+
+}
+
+// -------------------------------------------------------
+
+// Monotonic date (sec). The durations feed the link cost model, a
+// wall clock change must not distort them.
+double TransactionScheduler::Now() {
+
+#ifdef WIN32
+  LARGE_INTEGER freq,count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif
+
+}
@@ -0,0 +1,219 @@
+//+*********************************************************************
+//
+// File:        TransactionScheduler.h
+//
+// Project:     Modbus
+//
+// Description: Transaction scheduler owning the Modbus transport
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#ifndef _TransactionScheduler_H
+#define _TransactionScheduler_H
+
+#include <ModbusCore.h>
+
+// -----------------------------------------------------------------
+// Request classes. A lower lane number has a higher priority.
+// -----------------------------------------------------------------
+
+#define CONTROL_LANE      0   // Writes
+#define INTERACTIVE_LANE  1   // Reads requested by clients
+#define BACKGROUND_LANE   2   // Cache thread polling
+#define NB_LANES          3
+
+// Strict priority: a transaction waiting longer (sec) is served first
+#define LANE_MAX_WAIT     0.5
+
+// Dispatcher wait for a push not linked yet: yields, then sleeps (ns)
+#define TAKE_SPIN         64
+#define TAKE_SLEEP_NS     100000
+
+// -----------------------------------------------------------------
+// Scheduler statistics
+// -----------------------------------------------------------------
+
+struct LaneStatistics {
+  unsigned long nb_transactions;
+  double mean_wait;
+  double max_wait;
+};
+
+struct SchedulerStatistics {
+  unsigned long nb_transactions;  // Transactions done
+  long queue_depth;               // Transactions waiting or running
+  long max_queue_depth;
+  double mean_wait;               // Time in queue (sec)
+  double max_wait;
+  double mean_service;            // Time on the wire (sec)
+  double max_service;
+  LaneStatistics lanes[NB_LANES];
+};
+
+// -----------------------------------------------------------------
+// Transaction scheduler. It is a ModbusCore which forwards the
+// exchanges to the real transport. The callers (commands, cache
+// and write threads) submit their transactions through lock-free
+// multiple producers / single consumer queues, one per lane, and a
+// dispatcher thread is the only one talking on the wire.
+// The lane is chosen from the function code (writes) and from the
+// calling thread (cache polling). The dispatcher serves the lanes by
+// strict priority, or by weighted round robin when weights are given.
+// With a control transport, the control lane has its own dispatcher
+// and connection and does not wait for the polling at all.
+// -----------------------------------------------------------------
+
+class TransactionScheduler: public ModbusCore {
+
+public:
+
+   // The scheduler takes the ownership of the transports.
+   // weights: empty (strict priority) or one weight per lane.
+   TransactionScheduler(ModbusCore *core,
+                        ModbusCore *controlCore,
+                        const vector<long> &weights);
+   ~TransactionScheduler();
+
+   // Return state
+   Tango::DevState State();
+
+   // Return status
+   string Status();
+
+   // Send a query and wait for the answer
+   void SendGet (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short response_length);
+
+   // Same, also return the time spent on the wire (sec)
+   void SendGet (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short response_length,
+	         double *service);
+
+   // Send a query and ignore answer
+   void Send ( unsigned char *query,
+  	       short query_length);
+
+   // Send several queries in one transaction
+   void SendGetPipelined (vector<ModbusRequest> &requests);
+
+   // Send a query with a variable length answer
+   short SendGetCounted (unsigned char *query,
+	         short query_length,
+	         unsigned char *response,
+	         short max_length);
+
+   // Transactions from the threads for which isBackground(thread id)
+   // is true go to the background lane
+   void SetBackgroundThreads(bool (*isBackground)(int id));
+
+   void GetStatistics(SchedulerStatistics &stats);
+
+private:
+
+  typedef enum {
+    SEND_GET,
+    SEND,
+    SEND_GET_PIPELINED,
+    SEND_GET_COUNTED,
+    EXIT
+  } TransactionType;
+
+  // A transaction lives on the stack of the submitting thread
+  struct Transaction {
+    TransactionType type;
+    unsigned char *query;
+    short query_length;
+    unsigned char *response;
+    short response_length;
+    vector<ModbusRequest> *requests;
+    short result;
+    bool failed;
+    Tango::DevFailed error;
+    int lane;
+    double submit_date;
+    double service;
+    omni_semaphore *done;
+    Transaction *next;
+  };
+
+  // MPSC queue (intrusive, with a stub node)
+  struct Queue {
+    Transaction * volatile head;
+    Transaction *tail;
+    Transaction stub;
+  };
+
+  // One dispatcher per transport, serving lanes firstLane..lastLane
+  class Dispatcher: public omni_thread {
+  public:
+    Dispatcher(TransactionScheduler *s,ModbusCore *c,int first,int last):
+      sched(s),core(c),firstLane(first),lastLane(last),wakeup(0) {}
+    void *run_undetached(void *) { sched->Dispatch(this); return NULL; }
+    void start() { start_undetached(); }
+    TransactionScheduler *sched;
+    ModbusCore *core;
+    int firstLane;
+    int lastLane;
+    long credits[NB_LANES];
+    omni_semaphore wakeup;
+  };
+
+  ModbusCore *core;
+  ModbusCore *controlCore;
+  vector<Dispatcher *> dispatchers;
+  Dispatcher *laneOwner[NB_LANES];
+  Queue queues[NB_LANES];
+  long weights[NB_LANES];
+  bool weighted;
+  bool (*isBackgroundThread)(int id);
+  volatile long queueDepth;
+  volatile bool stopping;
+  volatile long submitting;       // Submit() calls between check and push
+
+  omni_mutex statsMutex;
+  SchedulerStatistics stats;
+  double sumWait;
+  double sumService;
+  double sumLaneWait[NB_LANES];
+
+  int GetLane(unsigned char functionCode);
+  void Submit(Transaction &t,unsigned char functionCode);
+  void Push(Transaction *t);
+  Transaction *Pop(Queue &q);
+  Transaction *Peek(Queue &q);
+  Transaction *Next(Dispatcher *d);
+  Transaction *Take(Dispatcher *d);
+  void Dispatch(Dispatcher *d);
+  void Cancel(Dispatcher *d);
+  void Execute(ModbusCore *c,Transaction &t);
+  static double Now();
+
+};
+
+#endif /* _TransactionScheduler_H */
@@ -0,0 +1,281 @@
+//=============================================================================
+//
+// file :        WriteThread.cpp
+//
+// description : Thread flushing the asynchronous write queue
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <tango.h>
+#include <WriteThread.h>
+#include <Modbus.h>
+
+namespace Modbus_ns
+{
+
+//+======================================================================
+// Method:    WriteThread::WriteThread()
+//
+// Description:	create the instance of the thread used to flush the
+//				asynchronous write queue
+//
+// Arg(s) In: - period : Minimum time between two flushes (ms)
+//			  - d : Modbus device
+//-=====================================================================
+
+WriteThread::WriteThread(long period,Modbus *d):
+cond(&mutex),exit_flag(false),the_dev(d)
+{
+	if (period < 0)
+		period = 0;
+	sleeping_time_s = period / 1000;
+	sleeping_time_ns = (period % 1000) * 1000000;
+
+	status.nb_pending = 0;
+	status.nb_queued = 0;
+	status.last_done = 0;
+	status.nb_written = 0;
+	status.nb_frames = 0;
+	status.nb_failed = 0;
+}
+
+//+======================================================================
+// Method:    WriteThread::write_register() / write_coil()
+//
+// Description:	Queue a write and wake up the thread. Return the
+//				write id (see AsyncWriteStatus).
+//-=====================================================================
+
+unsigned long WriteThread::write_register(long adr,short value)
+{
+	return queue_write(false,adr,value);
+}
+
+unsigned long WriteThread::write_coil(long adr,short value)
+{
+	return queue_write(true,adr,(value != 0) ? 1 : 0);
+}
+
+unsigned long WriteThread::queue_write(bool coil,long adr,short value)
+{
+	omni_mutex_lock sync(mutex);
+	QueuedWrite w;
+	w.id = ++status.nb_queued;
+	w.coil = coil;
+	w.adr = adr;
+	w.value = value;
+	queue.push_back(w);
+	status.nb_pending++;
+	cond.signal();
+	return w.id;
+}
+
+//+======================================================================
+// Method:    WriteThread::stop()
+//
+// Description:	Ask the thread to exit once the queue is flushed
+//-=====================================================================
+
+void WriteThread::stop()
+{
+	omni_mutex_lock sync(mutex);
+	exit_flag = true;
+	cond.signal();
+}
+
+//+======================================================================
+// Method:    WriteThread::get_status()
+//-=====================================================================
+
+void WriteThread::get_status(WriteQueueStatus &st)
+{
+	omni_mutex_lock sync(mutex);
+	st = status;
+}
+
+//+======================================================================
+// Method:    WriteThread::run_undetached()
+//
+// Description:	Thread loop. Take the whole queue, write it and wait
+//				before the next flush so that writes received meanwhile
+//				are merged.
+//-=====================================================================
+
+void *WriteThread::run_undetached(void *ptr)
+{
+	while (true)
+	{
+		deque<QueuedWrite> writes;
+		bool exit;
+
+		{
+			omni_mutex_lock sync(mutex);
+			while (queue.empty() && (exit_flag == false))
+				cond.wait();
+			if (queue.empty())
+				break;
+			writes.swap(queue);
+		}
+
+		flush(writes);
+
+		{
+			omni_mutex_lock sync(mutex);
+			exit = exit_flag;
+		}
+
+		if (exit == false)
+			omni_thread::sleep(sleeping_time_s,sleeping_time_ns);
+	}
+
+	return NULL;
+}
+
+//+======================================================================
+// Method:    WriteThread::flush()
+//
+// Description:	Write the queued values in their order. Consecutive
+//				writes of the same type to adjacent increasing
+//				addresses go in one FC16 (registers) or FC15 (coils)
+//				frame. A single value uses FC6 or FC5.
+//-=====================================================================
+
+void WriteThread::flush(deque<QueuedWrite> &writes)
+{
+	size_t first = 0;
+
+	while (first < writes.size())
+	{
+		bool coil = writes[first].coil;
+		long adr = writes[first].adr;
+		long max_nb = (coil == true) ? MAX_NB_WRITE_COIL : MAX_NB_WRITE_REG;
+		vector<short> run;
+
+		while ((first + run.size() < writes.size()) && ((long)run.size() < max_nb) &&
+			   (writes[first + run.size()].coil == coil) &&
+			   (writes[first + run.size()].adr == adr + (long)run.size()))
+			run.push_back(writes[first + run.size()].value);
+
+		long nb = run.size();
+		unsigned char query[MAX_FRAME_SIZE];
+		short query_length;
+
+		if (nb == 1)
+		{
+			query[0] = (coil == true) ? FORCE_SINGLE_COIL : PRESET_SINGLE_REGISTER;
+			query[1] = adr >> 8;
+			query[2] = adr & 0xff;
+			if (coil == true)
+			{
+				query[3] = (run[0] != 0) ? 0xff : 0x00;
+				query[4] = 0x00;
+			}
+			else
+			{
+				query[3] = run[0] >> 8;
+				query[4] = run[0] & 0xff;
+			}
+			query_length = 5;
+		}
+		else
+		{
+			query[0] = (coil == true) ? FORCE_MULTIPLE_COILS : PRESET_MULTIPLE_REGISTERS;
+			query[1] = adr >> 8;
+			query[2] = adr & 0xff;
+			query[3] = nb >> 8;
+			query[4] = nb & 0xff;
+			if (coil == true)
+			{
+				query[5] = (nb + 7) / 8;
+				memset(query + 6,0,query[5]);
+				for (long i = 0;i < nb;i++)
+					if (run[i] != 0)
+						query[6 + i/8] |= (1 << (i%8));
+			}
+			else
+			{
+				query[5] = nb * 2;
+				for (long i = 0;i < nb;i++)
+				{
+					query[6 + i*2] = run[i] >> 8;
+					query[6 + i*2 + 1] = run[i] & 0xff;
+				}
+			}
+			query_length = 6 + query[5];
+		}
+
+		send_frame(query,query_length,&writes[first],nb);
+		first += nb;
+	}
+}
+
+//+======================================================================
+// Method:    WriteThread::send_frame()
+//
+// Description:	Send one write frame (the nb writes from w) and
+//				update the queue status. Values which failed are
+//				dropped and kept in the status (last ones only), a
+//				newer write will be queued by the client.
+//-=====================================================================
+
+void WriteThread::send_frame(unsigned char *query,short query_length,const QueuedWrite *w,long nb)
+{
+	unsigned char response[MAX_FRAME_SIZE];
+	string err;
+
+	try
+	{
+		the_dev->SendGet(query,query_length,response,5);
+	}
+	catch (Tango::DevFailed &e)
+	{
+		err = e.errors[0].desc;
+	}
+
+	omni_mutex_lock sync(mutex);
+	status.nb_pending -= nb;
+	status.nb_frames++;
+	status.last_done = w[nb - 1].id;
+	if (err.empty() == true)
+		status.nb_written += nb;
+	else
+	{
+		status.nb_failed += nb;
+		status.last_error = err;
+		for (long i = 0;i < nb;i++)
+		{
+			FailedWrite f;
+			f.write = w[i];
+			f.error = err;
+			status.failed.push_back(f);
+			if (status.failed.size() > WRITE_QUEUE_MAX_FAILED)
+				status.failed.pop_front();
+		}
+	}
+}
+
+} // End of namespace
@@ -0,0 +1,115 @@
+//+*********************************************************************
+//
+// File:        WriteThread.h
+//
+// Project:     Modbus
+//
+// Description: public include file containing definitions and declarations
+//		for implementing the thread dedicated to flushing the
+//		asynchronous write queue
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#ifndef _WriteThread_H
+#define _WriteThread_H
+
+#include <tango.h>
+#include <deque>
+
+//+=====================================================================
+// Class definition
+//-=====================================================================
+
+namespace Modbus_ns
+{
+
+class Modbus;
+
+// Number of failed writes kept in the status
+#define WRITE_QUEUE_MAX_FAILED		16
+
+struct QueuedWrite
+{
+	unsigned long		id;				// Submission number, from 1
+	bool				coil;
+	long				adr;
+	short				value;
+};
+
+struct FailedWrite
+{
+	QueuedWrite			write;
+	string				error;
+};
+
+struct WriteQueueStatus
+{
+	unsigned long		nb_pending;		// Queued or being written
+	unsigned long		nb_queued;		// Total number of queued writes (last id)
+	unsigned long		last_done;		// Id of the last write done
+	unsigned long		nb_written;		// Values written
+	unsigned long		nb_frames;		// Frames sent
+	unsigned long		nb_failed;		// Values which failed to be written
+	string				last_error;
+	deque<FailedWrite>	failed;			// Last failed writes, oldest first
+};
+
+class WriteThread: public omni_thread
+{
+public:
+	WriteThread(long,Modbus *);
+	~WriteThread() {}
+
+	void *run_undetached(void *);
+	void start() {start_undetached();}
+
+	// Queue a write and return its id. The writes are done in their
+	// order, each one is sent (no value replaces a queued one).
+	unsigned long write_register(long,short);
+	unsigned long write_coil(long,short);
+
+	// Flush the queue and exit
+	void stop();
+
+	void get_status(WriteQueueStatus &);
+
+protected:
+	unsigned long queue_write(bool,long,short);
+	void flush(deque<QueuedWrite> &);
+	void send_frame(unsigned char *,short,const QueuedWrite *,long);
+
+	omni_mutex					mutex;
+	omni_condition				cond;
+	deque<QueuedWrite>			queue;
+	bool						exit_flag;
+	unsigned long				sleeping_time_s;
+	unsigned long				sleeping_time_ns;
+	WriteQueueStatus			status;
+	Modbus						*the_dev;
+};
+
+} // End of namespace
+
+#endif /* _WriteThread_H */
@@ -0,0 +1,59 @@
+//+*********************************************************************
+//
+// File:        Check.h
+//
+// Project:     Modbus
+//
+// Description: Check macro of the unit checks. A failed check is
+//		reported and the program exits with an error once all
+//		the checks ran.
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#ifndef _Check_H
+#define _Check_H
+
+#include <stdio.h>
+
+static int nb_checks = 0;
+static int nb_failed = 0;
+
+#define CHECK(cond)															\
+	do {																	\
+		nb_checks++;														\
+		if (!(cond)) {														\
+			nb_failed++;													\
+			fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#cond);	\
+		}																	\
+	} while (0)
+
+// Exit status of the check program
+inline int check_result(const char *name)
+{
+	printf("%s: %d checks, %d failed\n",name,nb_checks,nb_failed);
+	return (nb_failed == 0) ? 0 : 1;
+}
+
+#endif /* _Check_H */
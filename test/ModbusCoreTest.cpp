@@ -0,0 +1,329 @@
+//=============================================================================
+//
+// file :        ModbusCoreTest.cpp
+//
+// description : Unit checks of the counted answers (SendGetCounted): CRC,
+//               byte count and modbus errors on RTU (scripted serial
+//               line), transaction id and length on TCP (local server)
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <ModbusCore.h>
+#include <Check.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+vector<unsigned char>	Tango::FakeSerial::written;
+deque<unsigned char>	Tango::FakeSerial::answer;
+
+using Tango::FakeSerial;
+
+// Query of a FIFO read, and the FIFO content of the answers
+static unsigned char fifo_query[3] = {READ_FIFO_QUEUE,0x04,0xDE};
+static const unsigned char fifo_pdu[9] = {READ_FIFO_QUEUE,0x00,0x06,0x00,0x02,0x01,0xB8,0x12,0x84};
+
+//+======================================================================
+// Modbus CRC16, bitwise (the device class uses a table)
+//-=====================================================================
+
+static void add_crc(vector<unsigned char> &frame)
+{
+	unsigned short crc = 0xFFFF;
+	for (size_t i = 0;i < frame.size();i++)
+	{
+		crc ^= frame[i];
+		for (int b = 0;b < 8;b++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+	}
+	frame.push_back(crc & 0xFF);
+	frame.push_back(crc >> 8);
+}
+
+// Send the query, return the answer length or -1 and the error
+static short rtu_send(ModbusRTU &rtu,const vector<unsigned char> &answer,unsigned char *response,short max_length,string &error)
+{
+	FakeSerial::written.clear();
+	FakeSerial::answer.assign(answer.begin(),answer.end());
+	try
+	{
+		return rtu.SendGetCounted(fifo_query,3,response,max_length);
+	}
+	catch (Tango::DevFailed &e)
+	{
+		error = e.errors[0].desc;
+		return -1;
+	}
+}
+
+//+======================================================================
+// RTU: the answer is read in three parts, node and function code, byte
+// count, then the data and the CRC
+//-=====================================================================
+
+static void check_rtu()
+{
+	ModbusRTU rtu("serial/test/1",17,"");
+	unsigned char response[MAX_FRAME_SIZE];
+	string error;
+
+	vector<unsigned char> good(1,17);
+	good.insert(good.end(),fifo_pdu,fifo_pdu + 9);
+	add_crc(good);
+
+	// Query frame: node, query, CRC
+	vector<unsigned char> query(1,17);
+	query.insert(query.end(),fifo_query,fifo_query + 3);
+	add_crc(query);
+
+	short lgth = rtu_send(rtu,good,response,MAX_FRAME_SIZE,error);
+	CHECK(FakeSerial::written == query);
+	CHECK(lgth == 9);
+	CHECK((lgth == 9) && (memcmp(response,fifo_pdu,9) == 0));
+	CHECK(FakeSerial::answer.empty());
+	CHECK(rtu.State() == Tango::ON);
+
+	// Just fits
+	CHECK(rtu_send(rtu,good,response,9,error) == 9);
+
+	// Any wrong CRC byte is an error
+	for (size_t i = good.size() - 2;i < good.size();i++)
+	{
+		vector<unsigned char> bad = good;
+		bad[i] ^= 0x01;
+		error = "";
+		CHECK(rtu_send(rtu,bad,response,MAX_FRAME_SIZE,error) == -1);
+		CHECK(error == "Invalid CRC");
+	}
+	CHECK(rtu.State() == Tango::UNKNOWN);
+
+	// Corrupted data
+	vector<unsigned char> bad = good;
+	bad[6] ^= 0x40;
+	error = "";
+	CHECK(rtu_send(rtu,bad,response,MAX_FRAME_SIZE,error) == -1);
+	CHECK(error == "Invalid CRC");
+
+	// Byte count above max_length
+	error = "";
+	CHECK(rtu_send(rtu,good,response,8,error) == -1);
+	CHECK(error.find("Unexpected response length") == 0);
+
+	// Byte count of 0x8000 and more
+	vector<unsigned char> huge(1,17);
+	huge.push_back(READ_FIFO_QUEUE);
+	huge.push_back(0xFF);
+	huge.push_back(0xF0);
+	error = "";
+	CHECK(rtu_send(rtu,huge,response,MAX_FRAME_SIZE,error) == -1);
+	CHECK(error.find("Unexpected response length") == 0);
+
+	// Answer ended early (timeout)
+	vector<unsigned char> truncated(good.begin(),good.end() - 3);
+	error = "";
+	CHECK(rtu_send(rtu,truncated,response,MAX_FRAME_SIZE,error) == -1);
+	CHECK(error == "Unexpected message size (missing char)");
+	truncated.assign(good.begin(),good.begin() + 3);
+	error = "";
+	CHECK(rtu_send(rtu,truncated,response,MAX_FRAME_SIZE,error) == -1);
+	CHECK(error == "Unexpected message size (missing char)");
+
+	// Modbus exception
+	vector<unsigned char> exc(1,17);
+	exc.push_back(READ_FIFO_QUEUE | 0x80);
+	exc.push_back(0x02);
+	add_crc(exc);
+	error = "";
+	CHECK(rtu_send(rtu,exc,response,MAX_FRAME_SIZE,error) == -1);
+	CHECK(error == "Register address not allowed");
+}
+
+//+======================================================================
+// TCP: a local server answers each query as set by tcp_answer
+//-=====================================================================
+
+enum TcpAnswer {TCP_GOOD,TCP_LATE_SAME_READ,TCP_LATE_OTHER_READ,TCP_SHORT,TCP_HUGE_COUNT,TCP_EXCEPTION};
+
+static volatile TcpAnswer tcp_answer = TCP_GOOD;
+
+// MBAP header and PDU
+static void add_tcp_frame(vector<unsigned char> &out,unsigned short tid,const unsigned char *pdu,size_t lgth)
+{
+	out.push_back(tid >> 8);
+	out.push_back(tid & 0xFF);
+	out.push_back(0);
+	out.push_back(0);
+	out.push_back((lgth + 1) >> 8);
+	out.push_back((lgth + 1) & 0xFF);
+	out.push_back(17);
+	out.insert(out.end(),pdu,pdu + lgth);
+}
+
+static void *tcp_server(void *arg)
+{
+	int listen_sock = *(int *)arg;
+	int sock = accept(listen_sock,NULL,NULL);
+	unsigned char query[MAX_FRAME_SIZE];
+
+	while (sock >= 0)
+	{
+		if (recv(sock,query,MAX_FRAME_SIZE,0) <= 0)
+			break;
+		unsigned short tid = (query[0] << 8) | query[1];
+		vector<unsigned char> out;
+		static const unsigned char other_pdu[5] = {READ_HOLDING_REGISTERS,0x02,0x55,0x55};
+
+		switch (tcp_answer)
+		{
+			case TCP_GOOD:
+				add_tcp_frame(out,tid,fifo_pdu,9);
+				break;
+
+			case TCP_LATE_SAME_READ:
+				add_tcp_frame(out,tid - 1,other_pdu,4);
+				add_tcp_frame(out,tid,fifo_pdu,9);
+				break;
+
+			case TCP_LATE_OTHER_READ:
+				add_tcp_frame(out,tid - 1,other_pdu,4);
+				send(sock,&out[0],out.size(),0);
+				usleep(50000);
+				out.clear();
+				add_tcp_frame(out,tid,fifo_pdu,9);
+				break;
+
+			case TCP_SHORT:
+				add_tcp_frame(out,tid,fifo_pdu,7);
+				break;
+
+			case TCP_HUGE_COUNT:
+			{
+				unsigned char pdu[9];
+				memcpy(pdu,fifo_pdu,9);
+				pdu[1] = 0xFF;
+				pdu[2] = 0xF0;
+				add_tcp_frame(out,tid,pdu,9);
+				break;
+			}
+
+			case TCP_EXCEPTION:
+			{
+				unsigned char pdu[2] = {READ_FIFO_QUEUE | 0x80,0x02};
+				add_tcp_frame(out,tid,pdu,2);
+				break;
+			}
+		}
+		send(sock,&out[0],out.size(),0);
+	}
+
+	if (sock >= 0)
+		close(sock);
+	return NULL;
+}
+
+static short tcp_send(ModbusTCP &tcp,TcpAnswer answer,unsigned char *response,short max_length,string &error)
+{
+	tcp_answer = answer;
+	error = "";
+	try
+	{
+		return tcp.SendGetCounted(fifo_query,3,response,max_length);
+	}
+	catch (Tango::DevFailed &e)
+	{
+		error = e.errors[0].desc;
+		return -1;
+	}
+}
+
+static void check_tcp()
+{
+	// The port is a short (Port property): first free one from 15020
+	int listen_sock = socket(AF_INET,SOCK_STREAM,0);
+	struct sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	short port;
+	for (port = 15020;port < 15120;port++)
+	{
+		addr.sin_port = htons(port);
+		if (bind(listen_sock,(struct sockaddr *)&addr,sizeof(addr)) == 0)
+			break;
+	}
+	if ((port == 15120) || (listen(listen_sock,1) != 0))
+	{
+		perror("ModbusCoreTest: local server");
+		CHECK(false);
+		return;
+	}
+
+	pthread_t server;
+	pthread_create(&server,NULL,tcp_server,&listen_sock);
+
+	unsigned char response[MAX_FRAME_SIZE];
+	string error;
+	{
+		ModbusTCP tcp("127.0.0.1",port,17,1.0,1.0,true,false,false,1);
+
+		CHECK(tcp_send(tcp,TCP_GOOD,response,MAX_FRAME_SIZE,error) == 9);
+		CHECK(memcmp(response,fifo_pdu,9) == 0);
+
+		// Late answers of a previous transaction are dropped
+		memset(response,0,sizeof(response));
+		CHECK(tcp_send(tcp,TCP_LATE_SAME_READ,response,MAX_FRAME_SIZE,error) == 9);
+		CHECK(memcmp(response,fifo_pdu,9) == 0);
+		memset(response,0,sizeof(response));
+		CHECK(tcp_send(tcp,TCP_LATE_OTHER_READ,response,MAX_FRAME_SIZE,error) == 9);
+		CHECK(memcmp(response,fifo_pdu,9) == 0);
+
+		// Byte count above max_length or above the bytes received
+		CHECK(tcp_send(tcp,TCP_GOOD,response,8,error) == -1);
+		CHECK(error.find("Unexpected response length") == 0);
+		CHECK(tcp_send(tcp,TCP_SHORT,response,MAX_FRAME_SIZE,error) == -1);
+		CHECK(error.find("Unexpected response length") == 0);
+		CHECK(tcp_send(tcp,TCP_HUGE_COUNT,response,MAX_FRAME_SIZE,error) == -1);
+		CHECK(error.find("Unexpected response length") == 0);
+
+		CHECK(tcp_send(tcp,TCP_EXCEPTION,response,MAX_FRAME_SIZE,error) == -1);
+		CHECK(error == "Register address not allowed");
+
+		// Still in sync
+		CHECK(tcp_send(tcp,TCP_GOOD,response,MAX_FRAME_SIZE,error) == 9);
+	}
+
+	pthread_join(server,NULL);
+	close(listen_sock);
+}
+
+int main(int,char **)
+{
+	check_rtu();
+	check_tcp();
+	return check_result("ModbusCoreTest");
+}
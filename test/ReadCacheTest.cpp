@@ -0,0 +1,209 @@
+//=============================================================================
+//
+// file :        ReadCacheTest.cpp
+//
+// description : Unit checks of the read-through cache: TTL, LRU eviction,
+//               invalidation and the generation log rejecting the ranges
+//               read before an overlapping write
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <ReadCache.h>
+#include <CacheThread.h>
+#include <Check.h>
+
+namespace Modbus_ns
+{
+
+// Clock set by the checks
+static long long fake_clock_us = 0;
+
+long long cache_clock_us()
+{
+	return fake_clock_us;
+}
+
+}
+
+using namespace Modbus_ns;
+
+static const short values[4] = {1,2,3,4};
+
+static bool cached(ReadCache &rc,unsigned char fc,long adr,long nb)
+{
+	vector<short> data;
+	unsigned long gen;
+	if (rc.get(fc,adr,nb,data,gen) == false)
+		return false;
+	return (data.size() == (size_t)nb) && (data[0] == values[0]);
+}
+
+static unsigned long generation(ReadCache &rc)
+{
+	vector<short> data;
+	unsigned long gen;
+	rc.get(0,0,0,data,gen);
+	return gen;
+}
+
+//+======================================================================
+// Hits, misses, TTL and LRU eviction
+//-=====================================================================
+
+static void check_lookup()
+{
+	ReadCache rc(2,100);
+	vector<short> data;
+	unsigned long gen;
+
+	fake_clock_us = 1000000;
+	CHECK(rc.get(READ_HOLDING_REGISTERS,10,4,data,gen) == false);
+	rc.put(READ_HOLDING_REGISTERS,10,4,values,gen);
+	CHECK(rc.get(READ_HOLDING_REGISTERS,10,4,data,gen) == true);
+	CHECK((data.size() == 4) && (data[3] == 4));
+
+	// Only the same request is served
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,3) == false);
+	CHECK(cached(rc,READ_INPUT_REGISTERS,10,4) == false);
+
+	// TTL
+	fake_clock_us += 100000;
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == true);
+	fake_clock_us += 1;
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == false);
+
+	// The least recently used range is evicted
+	gen = generation(rc);
+	rc.put(READ_HOLDING_REGISTERS,0,2,values,gen);
+	rc.put(READ_HOLDING_REGISTERS,20,2,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,0,2) == true);
+	rc.put(READ_HOLDING_REGISTERS,40,2,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,0,2) == true);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,20,2) == false);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,40,2) == true);
+
+	ReadCacheStatistics st;
+	rc.get_statistics(st);
+	CHECK(st.nb_entries == 2);
+	CHECK(st.nb_evicted == 1);
+	CHECK(st.nb_expired == 1);
+	CHECK(st.nb_hits == 5);
+}
+
+//+======================================================================
+// Invalidation of the cached ranges
+//-=====================================================================
+
+static void check_invalidate()
+{
+	ReadCache rc(16,1000);
+	unsigned long gen;
+
+	fake_clock_us = 1000000;
+	gen = generation(rc);
+	rc.put(READ_HOLDING_REGISTERS,0,4,values,gen);
+	rc.put(READ_HOLDING_REGISTERS,10,4,values,gen);
+	rc.put(READ_HOLDING_REGISTERS,20,4,values,gen);
+	rc.put(READ_INPUT_REGISTERS,10,4,values,gen);
+
+	rc.invalidate(READ_HOLDING_REGISTERS,13,8);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,0,4) == true);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == false);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,20,4) == false);
+	CHECK(cached(rc,READ_INPUT_REGISTERS,10,4) == true);
+
+	// Adjacent range kept
+	rc.invalidate(READ_HOLDING_REGISTERS,4,6);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,0,4) == true);
+
+	ReadCacheStatistics st;
+	rc.get_statistics(st);
+	CHECK(st.nb_invalidated == 2);
+	CHECK(generation(rc) == gen + 2);
+}
+
+//+======================================================================
+// A range read before an overlapping write is not stored
+//-=====================================================================
+
+static void check_generation_log()
+{
+	ReadCache rc(16,1000);
+	unsigned long gen;
+
+	fake_clock_us = 1000000;
+
+	// Overlapping write during the read
+	gen = generation(rc);
+	rc.invalidate(READ_HOLDING_REGISTERS,12,1);
+	rc.put(READ_HOLDING_REGISTERS,10,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == false);
+
+	// Write started after the read: stored
+	gen = generation(rc);
+	rc.put(READ_HOLDING_REGISTERS,10,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == true);
+
+	// Other range or other function code: stored
+	gen = generation(rc);
+	rc.invalidate(READ_HOLDING_REGISTERS,14,2);
+	rc.invalidate(READ_INPUT_REGISTERS,20,4);
+	rc.put(READ_HOLDING_REGISTERS,20,4,values,gen);
+	rc.put(READ_HOLDING_REGISTERS,10,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,20,4) == true);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,10,4) == true);
+
+	// Overlapping write among others
+	gen = generation(rc);
+	for (long i = 0;i < READ_CACHE_LOG_SIZE - 1;i++)
+		rc.invalidate(READ_HOLDING_REGISTERS,100 + i,1);
+	rc.invalidate(READ_HOLDING_REGISTERS,31,1);
+	rc.put(READ_HOLDING_REGISTERS,30,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,30,4) == false);
+
+	// Non overlapping writes, as many as logged
+	gen = generation(rc);
+	for (long i = 0;i < READ_CACHE_LOG_SIZE - 1;i++)
+		rc.invalidate(READ_HOLDING_REGISTERS,100 + i,1);
+	rc.put(READ_HOLDING_REGISTERS,30,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,30,4) == true);
+
+	// More than logged: the writes are unknown, not stored
+	gen = generation(rc);
+	for (long i = 0;i < READ_CACHE_LOG_SIZE;i++)
+		rc.invalidate(READ_HOLDING_REGISTERS,100 + i,1);
+	rc.put(READ_HOLDING_REGISTERS,40,4,values,gen);
+	CHECK(cached(rc,READ_HOLDING_REGISTERS,40,4) == false);
+}
+
+int main(int,char **)
+{
+	check_lookup();
+	check_invalidate();
+	check_generation_log();
+	return check_result("ReadCacheTest");
+}
@@ -0,0 +1,201 @@
+//=============================================================================
+//
+// file :        ReadPlannerTest.cpp
+//
+// description : Unit checks of the link cost model (LinkStats) and of the
+//               scattered read planner (plan_reads)
+//
+// project :     Modbus
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#include <ReadPlanner.h>
+#include <CacheThread.h>
+#include <Check.h>
+#include <math.h>
+#include <limits.h>
+
+namespace Modbus_ns
+{
+
+// The model does not read the clock, only LinkStats::now() does
+long long cache_clock_us()
+{
+	return 0;
+}
+
+}
+
+using namespace Modbus_ns;
+
+static bool near(double a,double b)
+{
+	return fabs(a - b) <= 1e-9 + 1e-6 * fabs(b);
+}
+
+//+======================================================================
+// LinkStats: defaults until LINK_STATS_MIN_SAMPLES exchanges, then the
+// fitted latency and byte rate
+//-=====================================================================
+
+static void check_link_stats()
+{
+	double latency,sec_per_byte;
+
+	LinkStats serial;
+	serial.get(latency,sec_per_byte);
+	CHECK(near(latency,0.005));
+	CHECK(near(sec_per_byte,10.0 / 115200.0));
+
+	LinkStats stats;
+	stats.set_default(0.001,1e-6);
+	for (long i = 0;i < 7;i++)
+		stats.add(10 + i * 20,0.002 + (10 + i * 20) * 1e-5);
+	CHECK(stats.is_fitted() == false);
+	CHECK(stats.get_nb_samples() == 7);
+	stats.get(latency,sec_per_byte);
+	CHECK(near(latency,0.001));
+	CHECK(near(sec_per_byte,1e-6));
+
+	stats.add(300,0.002 + 300 * 1e-5);
+	CHECK(stats.is_fitted() == true);
+	stats.get(latency,sec_per_byte);
+	CHECK(near(latency,0.002));
+	CHECK(near(sec_per_byte,1e-5));
+
+	// Same size exchanges: only the latency is fitted
+	LinkStats same;
+	same.set_default(0.001,1e-6);
+	for (long i = 0;i < 20;i++)
+		same.add(100,0.003);
+	same.get(latency,sec_per_byte);
+	CHECK(near(sec_per_byte,1e-6));
+	CHECK(near(latency,0.003 - 100 * 1e-6));
+
+	// Never a negative latency
+	LinkStats fast;
+	for (long i = 0;i < 20;i++)
+		fast.add(10 + i * 10,(10 + i * 10) * 1e-6 - 1e-4);
+	fast.get(latency,sec_per_byte);
+	CHECK(latency == 0.0);
+}
+
+//+======================================================================
+// Frames returned by plan_reads(): in address order, within the frame
+// size and covering all the addresses
+//-=====================================================================
+
+static bool valid_plan(const vector<long> &addresses,long max_per_frame,const vector<ReadFrame> &frames)
+{
+	size_t a = 0;
+	long end = LONG_MIN;
+	for (size_t f = 0;f < frames.size();f++)
+	{
+		if ((frames[f].count < 1) || (frames[f].count > max_per_frame) || (frames[f].address < end))
+			return false;
+		end = frames[f].address + frames[f].count;
+		while ((a < addresses.size()) && (addresses[a] < end))
+		{
+			if (addresses[a] < frames[f].address)
+				return false;
+			a++;
+		}
+	}
+	return a == addresses.size();
+}
+
+static void check_plan_reads()
+{
+	vector<long> addresses;
+	vector<ReadFrame> frames;
+
+	plan_reads(addresses,MAX_NB_REG,2.0,0.005,1e-4,1,frames);
+	CHECK(frames.empty());
+
+	// Contiguous addresses: one frame
+	for (long a = 100;a < 110;a++)
+		addresses.push_back(a);
+	plan_reads(addresses,MAX_NB_REG,2.0,0.005,1e-4,1,frames);
+	CHECK(frames.size() == 1);
+	CHECK((frames[0].address == 100) && (frames[0].count == 10));
+
+	// A gap is read when a turn around costs more than its bytes
+	addresses.clear();
+	addresses.push_back(0);
+	addresses.push_back(50);
+	plan_reads(addresses,MAX_NB_REG,2.0,0.01,1e-6,1,frames);
+	CHECK(frames.size() == 1);
+	CHECK((frames[0].address == 0) && (frames[0].count == 51));
+
+	// and skipped when its bytes cost more
+	plan_reads(addresses,MAX_NB_REG,2.0,1e-6,1e-3,1,frames);
+	CHECK(frames.size() == 2);
+	CHECK((frames[0].address == 0) && (frames[0].count == 1));
+	CHECK((frames[1].address == 50) && (frames[1].count == 1));
+
+	// Pipelined frames share the latency: the gap is skipped
+	plan_reads(addresses,MAX_NB_REG,2.0,0.002,1e-5,16,frames);
+	CHECK(frames.size() == 2);
+	plan_reads(addresses,MAX_NB_REG,2.0,0.002,1e-5,1,frames);
+	CHECK(frames.size() == 1);
+
+	// Split at the frame size
+	addresses.clear();
+	for (long a = 0;a < 250;a++)
+		addresses.push_back(a);
+	plan_reads(addresses,MAX_NB_REG,2.0,0.005,1e-4,1,frames);
+	CHECK(frames.size() == 3);
+	CHECK(valid_plan(addresses,MAX_NB_REG,frames));
+
+	// Coils: 2000 per frame
+	plan_reads(addresses,MAX_NB_COIL,0.125,0.005,1e-4,1,frames);
+	CHECK(frames.size() == 1);
+
+	// Random address sets and link models
+	srand(1);
+	for (int loop = 0;loop < 500;loop++)
+	{
+		addresses.clear();
+		long a = rand() % 100;
+		long nb = 1 + rand() % 300;
+		for (long i = 0;i < nb;i++)
+		{
+			addresses.push_back(a);
+			a += 1 + ((rand() % 4 == 0) ? rand() % 200 : 0);
+		}
+		double latency = (rand() % 100) * 1e-4;
+		double sec_per_byte = (1 + rand() % 100) * 1e-6;
+		long depth = 1 + rand() % 8;
+		plan_reads(addresses,MAX_NB_REG,2.0,latency,sec_per_byte,depth,frames);
+		CHECK(valid_plan(addresses,MAX_NB_REG,frames));
+	}
+}
+
+int main(int,char **)
+{
+	check_link_stats();
+	check_plan_reads();
+	return check_result("ReadPlannerTest");
+}
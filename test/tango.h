@@ -0,0 +1,181 @@
+//+*********************************************************************
+//
+// File:        tango.h
+//
+// Project:     Modbus
+//
+// Description: Minimal stand in for the Tango and omniORB headers, used
+//		to build the unit checks of the classes which do not need
+//		a running Tango system (see Makefile). Only what these
+//		classes use is provided. The serial line device is
+//		replaced by FakeSerial.
+//
+// This file is part of Tango device class.
+//
+// Tango is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Tango is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Tango.  If not, see <http://www.gnu.org/licenses/>.
+//
+// $Author:  $
+//
+// $Revision:  $
+// $Date:  $
+//
+// $log:  $
+//
+//-*********************************************************************
+
+#ifndef _TestTango_H
+#define _TestTango_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+//
+// omniORB threads
+//
+
+class omni_mutex
+{
+public:
+	omni_mutex() {pthread_mutex_init(&m,NULL);}
+	~omni_mutex() {pthread_mutex_destroy(&m);}
+	void lock() {pthread_mutex_lock(&m);}
+	void unlock() {pthread_mutex_unlock(&m);}
+private:
+	pthread_mutex_t	m;
+};
+
+class omni_mutex_lock
+{
+public:
+	omni_mutex_lock(omni_mutex &m):mutex(m) {mutex.lock();}
+	~omni_mutex_lock() {mutex.unlock();}
+private:
+	omni_mutex	&mutex;
+};
+
+// The checks run in the main thread, no thread is started
+class omni_thread
+{
+public:
+	virtual ~omni_thread() {}
+	void start_undetached() {}
+	int id() const {return 0;}
+	static omni_thread *self() {return NULL;}
+	static void yield() {sched_yield();}
+protected:
+	virtual void *run_undetached(void *) {return NULL;}
+};
+
+//
+// Tango types, exceptions and device proxy
+//
+
+namespace Tango
+{
+
+typedef int DevLong;
+typedef short DevShort;
+
+enum DevState {ON,OFF,FAULT,UNKNOWN};
+
+struct DevError
+{
+	string	reason;
+	string	desc;
+	string	origin;
+};
+
+typedef vector<DevError> DevErrorList;
+
+class DevFailed
+{
+public:
+	DevFailed() {}
+	DevFailed(const DevErrorList &e):errors(e) {}
+	DevErrorList	errors;
+};
+
+class Except
+{
+public:
+	static void throw_exception(const char *reason,const char *desc,const char *origin)
+	{
+		DevError e;
+		e.reason = reason;
+		e.desc = desc;
+		e.origin = origin;
+		throw DevFailed(DevErrorList(1,e));
+	}
+};
+
+class DeviceData
+{
+public:
+	void operator<<(DevLong l) {lval = l;}
+	void operator<<(const vector<unsigned char> &c) {chars = c;}
+	void operator>>(vector<unsigned char> &c) {c = chars;}
+	DevLong					lval;
+	vector<unsigned char>	chars;
+};
+
+//
+// Serial line device: the frames written are kept, DevSerReadChar
+// returns the next bytes of the scripted answer (fewer when it ends,
+// as on a timeout)
+//
+
+struct FakeSerial
+{
+	static vector<unsigned char>	written;
+	static deque<unsigned char>		answer;
+};
+
+class DeviceProxy
+{
+public:
+	DeviceProxy(const string &) {}
+	DeviceData command_inout(const char *cmd,DeviceData &argin)
+	{
+		DeviceData argout;
+		if (strcmp(cmd,"DevSerWriteChar") == 0)
+			FakeSerial::written.insert(FakeSerial::written.end(),argin.chars.begin(),argin.chars.end());
+		else if (strcmp(cmd,"DevSerReadChar") == 0)
+		{
+			size_t nb = argin.lval >> 8;
+			while ((nb-- > 0) && (FakeSerial::answer.empty() == false))
+			{
+				argout.chars.push_back(FakeSerial::answer.front());
+				FakeSerial::answer.pop_front();
+			}
+		}
+		return argout;
+	}
+};
+
+} // End of namespace
+
+#endif /* _TestTango_H */